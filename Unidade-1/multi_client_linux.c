@@ -3,6 +3,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,18 +12,46 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#include "udp_bulk.h" // Protocolo do modo bulk (transferência em massa confiável)
+#include "udp_mcast.h" // Protocolo do modo mcast (fan-out por multicast + reparo por NACK)
+#include "udp_offload.h" // Lotes com UDP_GRO/UDP_SEGMENT (modo flood)
+
 /*
  * Cliente multi-thread (TCP e UDP)
  * - Cria N threads de cliente.
  * - Cada thread envia "MSGBASE-<idx>" e tenta ler a resposta.
- * - Para UDP, configura timeout de recebimento (SO_RCVTIMEO).
+ * - Modo bulk: envia um blob de MB megabytes ao udp_server em modo bulk (SACK, janela
+ *   AIMD, pacing e RTO adaptativo) e mostra o goodput. BULK_LOSS=p descarta uma fração p
+ *   dos pacotes de dados antes do envio (perda simulada, sem precisar de tc netem).
+ * - Modo mrecv: entra no grupo multicast do udp_server em modo mcast, pede por NACK as
+ *   mensagens que faltam e, após SEGUNDOS, mostra recebidas / reparadas / perdidas.
+ *   MCAST_LOSS=p descarta uma fração p dos pacotes recebidos do grupo (perda simulada).
+ * - UDP: timeout por requisição derivado do RTT (SRTT/RTTVAR, compartilhado entre as threads),
+ *   até --retries N retentativas com backoff exponencial e jitter e, com --hedge, um envio
+ *   duplicado após o p95 das latências observadas (vale a primeira resposta). Cada envio leva
+ *   "[c=<id>/<tentativa>]"; o servidor ecoa e respostas atrasadas não são confundidas.
+ *   UDP_LOSS=p descarta uma fração p dos envios (perda simulada).
+ * - Modo big: em uma conexão com o tcp_server, ecoa mensagens "BIG" de 64 KB a 16 MB nos
+ *   modos copy, splice e zerocopy (escolhido por mensagem) e mostra a vazão de cada um.
+ * - Modo flood: mantém FLOOD_WINDOW datagramas de TAM bytes em voo contra o udp_server em
+ *   modo offload durante SEGUNDOS, em lotes de sendmmsg/recvmmsg com UDP_SEGMENT/UDP_GRO
+ *   (UDP_OFFLOAD=0 desliga), e mostra ecos/s e CPU do cliente por pacote (getrusage).
  *
  * Uso:
- *   ./multi_client_linux tcp|udp IP PORTA N "MENSAGEM_BASE"
+ *   ./multi_client_linux tcp|udp IP PORTA N "MENSAGEM_BASE" [--hedge] [--retries N]
+ *   ./multi_client_linux bulk IP PORTA MB
+ *   ./multi_client_linux mrecv GRUPO PORTA_GRUPO IP_PUBLICADOR PORTA_PUBLICADOR SEGUNDOS
+ *   ./multi_client_linux big IP PORTA [TAM_KB] [copy|splice|zerocopy]
+ *   ./multi_client_linux flood IP PORTA SEGUNDOS [TAM]
  *
  * Exemplos:
  *   ./multi_client_linux tcp 192.168.56.10 5000 20 "HELLO"
  *   ./multi_client_linux udp 192.168.56.10 6000 50 "PING"
+ *   UDP_LOSS=0.2 ./multi_client_linux udp 192.168.56.10 6000 50 "PING" --hedge --retries 5
+ *   BULK_LOSS=0.01 ./multi_client_linux bulk 192.168.56.10 6000 200
+ *   MCAST_IF=127.0.0.1 ./multi_client_linux mrecv 239.1.2.3 7000 127.0.0.1 6000 10
+ *   ./multi_client_linux big 192.168.56.10 5000
+ *   UDP_OFFLOAD=0 ./multi_client_linux flood 127.0.0.1 6000 5 256
  */
 
 // Estrutura do job para cada thread
@@ -57,8 +86,8 @@ static void *run_tcp(void *p) {
     char buf[1024];
     // Formata mensagem com índice da thread
     int n = snprintf(buf, sizeof buf, "%s-%d", j->msg, j->idx);
-    // Envia dados para servidor
-    if (send(s, buf, n, 0) < 0) { perror("[TCP] send"); close(s); free(j); return NULL; }
+    // Envia dados para servidor; se falhar, ainda lê: o servidor pode ter recusado com "BUSY"
+    if (send(s, buf, n, MSG_NOSIGNAL) < 0) perror("[TCP] send");
 
     // Recebe resposta do servidor
     int r = recv(s, buf, sizeof buf - 1, 0);
@@ -76,19 +105,68 @@ static void *run_tcp(void *p) {
     return NULL;
 }
 
+/* ===========================
+ * UDP: timeout adaptativo, retentativas e hedge
+ * =========================== */
+#define UDP_RTO_INIT_US 1000000   // antes da primeira amostra (RFC 6298)
+#define UDP_RTO_MIN_US  20000
+#define UDP_RTO_MAX_US  30000000
+#define UDP_SAMPLES     256       // amostras recentes para o p95 do hedge
+#define UDP_MAX_TRIES   16
+
+// Estimador de RTT compartilhado pelas threads (todas falam com o mesmo servidor)
+static struct {
+    pthread_mutex_t mtx;
+    double srtt, rttvar;          // µs
+    uint64_t samples[UDP_SAMPLES];
+    size_t nsamples;
+} rtt_est = { .mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static int udp_retries = 3;       // --retries N
+static int udp_hedge;             // --hedge
+static double udp_loss;           // UDP_LOSS=p: descarta uma fração p dos envios (perda simulada)
+static uint32_t udp_corr_base;
+
+// Resultado de cada thread, para o resumo de latência
+static uint64_t *udp_lat; static int *udp_ok;
+
+static void rtt_sample(uint64_t rtt) {
+    pthread_mutex_lock(&rtt_est.mtx);
+    if (rtt_est.srtt == 0) { rtt_est.srtt = rtt; rtt_est.rttvar = rtt / 2.0; }
+    else {
+        double d = rtt_est.srtt > rtt ? rtt_est.srtt - rtt : rtt - rtt_est.srtt;
+        rtt_est.rttvar = 0.75 * rtt_est.rttvar + 0.25 * d;
+        rtt_est.srtt = 0.875 * rtt_est.srtt + 0.125 * rtt;
+    }
+    rtt_est.samples[rtt_est.nsamples++ % UDP_SAMPLES] = rtt;
+    pthread_mutex_unlock(&rtt_est.mtx);
+}
+
+// RTO = SRTT + 4 x RTTVAR; hedge = p95 das amostras recentes (0 se ainda há poucas)
+static void rtt_get(uint64_t *rto, uint64_t *p95) {
+    uint64_t v[UDP_SAMPLES];
+    pthread_mutex_lock(&rtt_est.mtx);
+    double r = rtt_est.srtt ? rtt_est.srtt + 4 * rtt_est.rttvar : UDP_RTO_INIT_US;
+    size_t n = rtt_est.nsamples < UDP_SAMPLES ? rtt_est.nsamples : UDP_SAMPLES;
+    memcpy(v, rtt_est.samples, n * sizeof *v);
+    pthread_mutex_unlock(&rtt_est.mtx);
+    *rto = r < UDP_RTO_MIN_US ? UDP_RTO_MIN_US : r > UDP_RTO_MAX_US ? UDP_RTO_MAX_US : (uint64_t) r;
+    *p95 = 0;
+    if (n < 20) return;
+    for (size_t i = 1; i < n; i++) {  // ordenação por inserção (n <= 256)
+        uint64_t x = v[i]; size_t k = i;
+        while (k && v[k - 1] > x) { v[k] = v[k - 1]; k--; }
+        v[k] = x;
+    }
+    *p95 = v[n * 95 / 100];
+}
+
 // Função executada por cada thread UDP
 static void *run_udp(void *p) {
     job_t *j = (job_t *)p;                       // Cast do parâmetro para job_t
     int s = socket(AF_INET, SOCK_DGRAM, 0);      // Cria socket UDP
     if (s < 0) { perror("[UDP] socket"); free(j); return NULL; }
 
-    // Timeout de 5s para recvfrom (para não travar a thread se não houver resposta)
-    struct timeval tv = { .tv_sec = 5, .tv_usec = 0 };
-    if (setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) != 0) {
-        perror("[UDP] setsockopt(SO_RCVTIMEO)");
-        // continua mesmo assim
-    }
-
     // Configura estrutura do servidor
     struct sockaddr_in srv = {0};
     srv.sin_family = AF_INET;
@@ -98,40 +176,658 @@ static void *run_udp(void *p) {
         close(s); free(j); return NULL;
     }
 
+    // ID de correlação: o servidor ecoa a mensagem, então "[c=<id>/<tentativa>]" volta na
+    // resposta e identifica a qual envio ela pertence (respostas atrasadas não se confundem)
+    uint32_t corr = udp_corr_base + (uint32_t) j->idx;
+    unsigned seed = corr;
+    uint64_t sent_at[UDP_MAX_TRIES + 1];  // índice = tentativa (1..UDP_MAX_TRIES)
+    int tries = 0, max_tries = 1 + udp_retries, hedged = 0;
+    if (max_tries > UDP_MAX_TRIES - 1) max_tries = UDP_MAX_TRIES - 1;  // reserva uma para o hedge
+
+    uint64_t t0 = bulk_now_us(), last_tx = 0;  // last_tx: envio que arma o timeout atual
+    double jit = 1;
     char buf[1024];
-    // Formata mensagem com índice da thread
-    int n = snprintf(buf, sizeof buf, "%s-%d", j->msg, j->idx);
+    int got = 0, att = 0, backoffs = 0;
+    for (;;) {
+        // O prazo é recalculado a cada volta: amostras de outras threads encurtam o RTO
+        // inicial de 1 s assim que o primeiro RTT é medido
+        uint64_t rto, p95, now = bulk_now_us();
+        rtt_get(&rto, &p95);
+        uint64_t back = rto << (backoffs < 20 ? backoffs : 20);
+        if (back > UDP_RTO_MAX_US) back = UDP_RTO_MAX_US;
+        uint64_t deadline = last_tx + (uint64_t) (back * jit);
+        uint64_t hedge_at = udp_hedge && !hedged && tries == 1 && p95 ? t0 + p95 : 0;
 
-    // Envia dados via UDP (sem conexão)
-    if (sendto(s, buf, n, 0, (struct sockaddr *)&srv, sizeof srv) < 0) {
-        perror("[UDP] sendto");
-        close(s); free(j); return NULL;
-    }
+        int resend = 0;
+        if (tries == 0 || (now >= deadline && tries < max_tries)) {
+            // Backoff exponencial com jitter (0,5x a 1,5x) a cada nova tentativa por timeout
+            if (tries) backoffs++;
+            jit = 0.5 + rand_r(&seed) / (RAND_MAX + 1.0);
+            last_tx = now; resend = 1;
+        } else if (now >= deadline) {
+            break;  // esgotou as tentativas
+        } else if (hedge_at && now >= hedge_at && max_tries < UDP_MAX_TRIES) {
+            resend = 1; hedged = 1; max_tries++;  // duplica após o p95, sem esperar o timeout
+        }
+        if (resend && tries < UDP_MAX_TRIES) {
+            tries++;
+            int n = snprintf(buf, sizeof buf, "[c=%08x/%d] %s-%d", corr, tries, j->msg, j->idx);
+            sent_at[tries] = now;
+            if (udp_loss > 0 && rand_r(&seed) / (RAND_MAX + 1.0) < udp_loss) { /* perdido */ }
+            else if (sendto(s, buf, n, 0, (struct sockaddr *)&srv, sizeof srv) < 0) perror("[UDP] sendto");
+            continue;
+        }
 
-    socklen_t sl = sizeof srv;
+        uint64_t wake = deadline;
+        if (hedge_at && hedge_at < wake) wake = hedge_at;
+        int ms = wake > now ? (int) ((wake - now + 999) / 1000) : 0;
+        if (ms > 50) ms = 50;  // reavalia o prazo com o estimador atualizado
+        struct pollfd pfd = { .fd = s, .events = POLLIN };
+        if (poll(&pfd, 1, ms) <= 0) continue;
 
-    // Recebe resposta via UDP
-    int r = recvfrom(s, buf, sizeof buf - 1, 0, (struct sockaddr *)&srv, &sl);
-    if (r > 0) {
+        int r = recv(s, buf, sizeof buf - 1, 0);
+        if (r <= 0) continue;
         buf[r] = '\0';
-        printf("[UDP %d] %s\n", j->idx, buf);  // Imprime resposta
-    } else {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            printf("[UDP %d] timeout aguardando resposta\n", j->idx);  // Imprime se houve timeout
-        } else {
-            perror("[UDP] recvfrom");
+        unsigned rc; int ra;
+        char *c = strstr(buf, "[c=");
+        if (!c || sscanf(c, "[c=%x/%d]", &rc, &ra) != 2 || rc != corr || ra < 1 || ra > tries) {
+            printf("[UDP %d] resposta de outra requisição ignorada\n", j->idx);
+            continue;
         }
+        // O eco da tentativa dá uma amostra sem ambiguidade (regra de Karn sem descartar retransmissões)
+        att = ra;
+        got = strncmp(buf, "BUSY", 4) != 0;  // recusada pelo controle de admissão: não insiste
+        if (got) rtt_sample(bulk_now_us() - sent_at[ra]);  // "BUSY" não passa pelo processamento
+        break;
     }
+
+    uint64_t lat = bulk_now_us() - t0;
+    udp_lat[j->idx - 1] = lat; udp_ok[j->idx - 1] = got;
+    if (got)
+        printf("[UDP %d] %s (%.1f ms, tentativa %d de %d%s)\n", j->idx, buf, lat / 1e3, att, tries,
+            hedged ? ", com hedge" : "");
+    else if (att)
+        printf("[UDP %d] recusada pelo servidor: %s (%.1f ms)\n", j->idx, buf, lat / 1e3);
+    else
+        printf("[UDP %d] sem resposta após %d tentativas (%.1f ms)\n", j->idx, tries, lat / 1e3);
     // UDP: O cliente encerra (simplesmente para de enviar/receber e fecha o socket)
     close(s);   // Fecha socket
     free(j);    // Libera memória do job
     return NULL;
 }
 
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Resumo das latências das requisições UDP respondidas
+static void udp_summary(int N) {
+    uint64_t *v = (uint64_t *) malloc(sizeof *v * (size_t) N);
+    int n = 0;
+    for (int i = 0; i < N; i++) if (udp_ok[i]) v[n++] = udp_lat[i];
+    qsort(v, (size_t) n, sizeof *v, cmp_u64);
+    if (n)
+        printf("[UDP] %d/%d respondidas; latência p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, máx %.1f ms; SRTT %.1f ms\n",
+            n, N, v[n / 2] / 1e3, v[n * 95 / 100] / 1e3, v[n * 99 / 100] / 1e3, v[n - 1] / 1e3, rtt_est.srtt / 1e3);
+    else
+        printf("[UDP] nenhuma resposta\n");
+    free(v);
+}
+
+/* ===========================
+ * Modo bulk (emissor)
+ * =========================== */
+enum { PK_NEW = 0, PK_FLY, PK_LOST, PK_ACKED };  // estado de cada pacote
+
+#define BULK_DUPTHRESH 3        // perdido se 3 pacotes posteriores já foram confirmados
+#define BULK_MAX_CWND  16384.0  // pacotes
+#define BULK_RTO_MIN   2000     // µs
+#define BULK_RTO_MAX   1000000  // µs
+#define BULK_BURST     16       // pacotes enviados de uma vez pelo pacing
+
+typedef struct {
+    int s;
+    struct sockaddr_in srv;
+    uint32_t xfer, mss, npk;
+    uint64_t total;
+    uint8_t *st;                              // estado por pacote
+    uint32_t *lost; size_t lhead, llen, lcap; // fila de retransmissão (ring)
+    uint32_t next, cum, high, scan, inflight; // high = maior pacote confirmado + 1
+    double cwnd, ssthresh;
+    int recovery; uint32_t recovery_end;
+    double srtt, rttvar; uint64_t rto;        // µs
+    uint64_t last_progress;
+    uint64_t sent, retrans, dropped, rtos;
+    double loss;                              // BULK_LOSS
+} bulk_tx_t;
+
+static void bulk_lost_push(bulk_tx_t *b, uint32_t seq) {
+    if (b->llen == b->lcap) {
+        size_t cap = b->lcap ? b->lcap * 2 : 1024;
+        uint32_t *q = (uint32_t *) malloc(cap * sizeof *q);
+        for (size_t i = 0; i < b->llen; i++) q[i] = b->lost[(b->lhead + i) % b->lcap];
+        free(b->lost); b->lost = q; b->lcap = cap; b->lhead = 0;
+    }
+    b->lost[(b->lhead + b->llen++) % b->lcap] = seq;
+    b->st[seq] = PK_LOST;
+    b->inflight--;
+}
+
+static void bulk_send_data(bulk_tx_t *b, uint32_t seq, int retrans) {
+    char pkt[sizeof(bulk_hdr_t) + BULK_MAX_MSS];
+    uint32_t len = seq == b->npk - 1 ? (uint32_t) (b->total - (uint64_t) seq * b->mss) : b->mss;
+    bulk_hdr_t *h = (bulk_hdr_t *) pkt;
+    *h = (bulk_hdr_t) { BULK_MAGIC, BULK_DATA, htons((uint16_t) len), htonl(b->xfer), htonl(seq),
+                        htonl((uint32_t) bulk_now_us()) };
+    bulk_fill(pkt + sizeof *h, len, seq);
+    b->st[seq] = PK_FLY; b->inflight++; b->sent++;
+    if (retrans) b->retrans++;
+    if (b->loss > 0 && drand48() < b->loss) { b->dropped++; return; }  // perda simulada
+    sendto(b->s, pkt, sizeof *h + len, 0, (struct sockaddr *) &b->srv, sizeof b->srv);
+}
+
+// Reduz a janela uma vez por episódio de perda (uma janela de dados)
+static void bulk_on_loss(bulk_tx_t *b) {
+    if (b->recovery) return;
+    b->ssthresh = (b->cwnd / 2 > 2 ? b->cwnd / 2 : 2);
+    b->cwnd = b->ssthresh;
+    b->recovery = 1; b->recovery_end = b->next;
+}
+
+static void bulk_mark_acked(bulk_tx_t *b, uint32_t from, uint32_t to, uint32_t *newly) {
+    for (uint32_t i = from; i < to && i < b->npk; i++) {
+        if (b->st[i] == PK_ACKED) continue;
+        if (b->st[i] == PK_FLY) b->inflight--;
+        b->st[i] = PK_ACKED; (*newly)++;
+    }
+}
+
+static void bulk_on_ack(bulk_tx_t *b, const char *pl, size_t plen, uint32_t cum, uint32_t ts) {
+    uint64_t now = bulk_now_us();
+    double rtt = (double) (uint32_t) ((uint32_t) now - ts);
+    if (ts && rtt < 10e6) {  // RFC 6298; o eco do timestamp identifica a transmissão (sem ambiguidade)
+        if (b->srtt == 0) { b->srtt = rtt; b->rttvar = rtt / 2; }
+        else { b->rttvar = 0.75 * b->rttvar + 0.25 * (b->srtt > rtt ? b->srtt - rtt : rtt - b->srtt); b->srtt = 0.875 * b->srtt + 0.125 * rtt; }
+        double rto = b->srtt + 4 * b->rttvar;
+        b->rto = rto < BULK_RTO_MIN ? BULK_RTO_MIN : rto > BULK_RTO_MAX ? BULK_RTO_MAX : (uint64_t) rto;
+    }
+
+    uint32_t newly = 0;
+    if (cum > b->cum) { bulk_mark_acked(b, b->cum, cum, &newly); b->cum = cum; }
+    uint32_t nb = 0;
+    if (plen >= 4) { memcpy(&nb, pl, 4); nb = ntohl(nb); }
+    for (uint32_t k = 0; k < nb && 4 + (k + 1) * 8 <= plen; k++) {
+        uint32_t r[2]; memcpy(r, pl + 4 + k * 8, 8);
+        uint32_t from = ntohl(r[0]), to = ntohl(r[1]);
+        bulk_mark_acked(b, from, to, &newly);
+        if (to > b->high) b->high = to;
+    }
+    if (b->cum > b->high) b->high = b->cum;
+
+    // Detecção de perda por SACK: pacotes em voo muito abaixo do maior confirmado
+    if (b->scan < b->cum) b->scan = b->cum;
+    int lost = 0;
+    for (; b->high > BULK_DUPTHRESH && b->scan < b->high - BULK_DUPTHRESH; b->scan++)
+        if (b->st[b->scan] == PK_FLY) { bulk_lost_push(b, b->scan); lost = 1; }
+    if (lost) bulk_on_loss(b);
+    if (b->recovery && b->cum >= b->recovery_end) b->recovery = 0;
+
+    if (newly) {
+        b->last_progress = now;
+        if (!b->recovery) {
+            if (b->cwnd < b->ssthresh) b->cwnd += newly;           // slow start
+            else b->cwnd += (double) newly / b->cwnd;              // crescimento aditivo
+            if (b->cwnd > BULK_MAX_CWND) b->cwnd = BULK_MAX_CWND;
+        }
+    }
+}
+
+// Envia o blob; retorna 0 se o servidor confirmou a soma esperada
+static int run_bulk(const char *ip, int port, uint64_t total) {
+    bulk_tx_t b = { 0 };
+    b.s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (b.s < 0) { perror("[BULK] socket"); return 1; }
+    int sz = 8 << 20;
+    setsockopt(b.s, SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    setsockopt(b.s, SOL_SOCKET, SO_SNDBUF, &sz, sizeof sz);
+    b.srv.sin_family = AF_INET;
+    b.srv.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &b.srv.sin_addr) != 1) { fprintf(stderr, "[BULK] IP invalido: %s\n", ip); return 1; }
+
+    const char *loss = getenv("BULK_LOSS");
+    b.loss = loss ? atof(loss) : 0;
+    srand48(getpid());
+    b.xfer = (uint32_t) getpid() ^ (uint32_t) bulk_now_us();
+    b.mss = BULK_MSS; b.total = total;
+    uint64_t npk = (total + b.mss - 1) / b.mss;
+    if (!total || npk > UINT32_MAX) { fprintf(stderr, "[BULK] tamanho inválido\n"); close(b.s); return 1; }
+    b.npk = (uint32_t) npk;
+    b.st = (uint8_t *) calloc(b.npk, 1);
+    if (!b.st) { perror("[BULK] calloc"); close(b.s); return 1; }
+    b.cwnd = 10; b.ssthresh = BULK_MAX_CWND; b.rto = 200000;
+
+    // Soma esperada (mesma função do servidor)
+    uint64_t expect = 0;
+    char tmp[BULK_MAX_MSS];
+    for (uint32_t i = 0; i < b.npk; i++) {
+        uint32_t len = i == b.npk - 1 ? (uint32_t) (total - (uint64_t) i * b.mss) : b.mss;
+        bulk_fill(tmp, len, i);
+        expect += bulk_hash(i, tmp, len);
+    }
+
+    char pkt[sizeof(bulk_hdr_t) + 4 + BULK_MAX_SACK * 8 + 64];
+    uint64_t t0 = bulk_now_us(), next_send = t0, last_probe = 0;
+    uint64_t done_bytes = 0, done_sum = 0;
+    int done = 0, started = 0;
+    while (!done) {
+        uint64_t now = bulk_now_us();
+        if (now - t0 > 600000000ull) { fprintf(stderr, "[BULK] desistindo após 10 min\n"); break; }
+
+        // START até o servidor responder; depois sonda se tudo foi confirmado mas o DONE não chegou
+        if ((!started || (b.cum == b.npk && !b.inflight)) && now - last_probe > (started ? b.rto : 200000)) {
+            bulk_hdr_t *h = (bulk_hdr_t *) pkt;
+            *h = (bulk_hdr_t) { BULK_MAGIC, BULK_START, htons(8), htonl(b.xfer), htonl(b.mss), 0 };
+            bulk_put64(pkt + sizeof *h, total);
+            sendto(b.s, pkt, sizeof *h + 8, 0, (struct sockaddr *) &b.srv, sizeof b.srv);
+            last_probe = now;
+        }
+
+        // RTO: sem progresso por um RTO, tudo em voo é considerado perdido
+        if (b.inflight && now - b.last_progress > b.rto) {
+            for (uint32_t i = b.cum; i < b.next; i++) if (b.st[i] == PK_FLY) bulk_lost_push(&b, i);
+            b.ssthresh = (b.cwnd / 2 > 2 ? b.cwnd / 2 : 2); b.cwnd = 2;
+            b.recovery = 0;
+            b.rto = b.rto * 2 > BULK_RTO_MAX ? BULK_RTO_MAX : b.rto * 2;  // backoff até a próxima amostra
+            b.last_progress = now; b.rtos++;
+        }
+
+        // Envio com pacing: taxa = 1.25 x cwnd / SRTT, em rajadas de até BULK_BURST pacotes
+        int burst = 0;
+        while (started && burst < BULK_BURST && b.inflight < (uint32_t) b.cwnd && now >= next_send) {
+            uint32_t seq;
+            int re = 0;
+            while (b.llen && b.st[b.lost[b.lhead]] != PK_LOST) { b.lhead = (b.lhead + 1) % b.lcap; b.llen--; }
+            if (b.llen) { seq = b.lost[b.lhead]; b.lhead = (b.lhead + 1) % b.lcap; b.llen--; re = 1; }
+            else if (b.next < b.npk) seq = b.next++;
+            else break;
+            if (!b.inflight) b.last_progress = now;
+            bulk_send_data(&b, seq, re);
+            burst++;
+        }
+        if (burst) {
+            double gap = b.srtt > 0 ? b.srtt / (1.25 * b.cwnd) : 0;
+            next_send = (next_send > now - 1000 ? next_send : now) + (uint64_t) (gap * burst);
+        }
+
+        // Espera ACK ou o próximo envio/RTO
+        int can_send = started && b.inflight < (uint32_t) b.cwnd && (b.llen || b.next < b.npk);
+        uint64_t wait = can_send ? (next_send > now ? next_send - now : 0) : (b.inflight ? b.rto : 20000);
+        struct timespec ts = { (time_t) (wait / 1000000), (long) (wait % 1000000) * 1000 };
+        struct pollfd pfd = { .fd = b.s, .events = POLLIN };
+        if (ppoll(&pfd, 1, &ts, NULL) <= 0) continue;
+
+        for (;;) {
+            ssize_t n = recv(b.s, pkt, sizeof pkt, MSG_DONTWAIT);
+            if (n < (ssize_t) sizeof(bulk_hdr_t)) break;
+            bulk_hdr_t h; memcpy(&h, pkt, sizeof h);
+            if (h.magic != BULK_MAGIC || ntohl(h.xfer) != b.xfer) continue;
+            if (h.type == BULK_DONE && n >= (ssize_t) (sizeof h + 16)) {
+                done_bytes = bulk_get64(pkt + sizeof h); done_sum = bulk_get64(pkt + sizeof h + 8);
+                done = 1; break;
+            }
+            if (h.type != BULK_ACK) continue;
+            if (!started) { started = 1; b.last_progress = bulk_now_us(); }
+            bulk_on_ack(&b, pkt + sizeof h, (size_t) n - sizeof h, ntohl(h.seq), ntohl(h.ts));
+        }
+    }
+
+    double secs = (bulk_now_us() - t0) / 1e6;
+    printf("[BULK] %llu bytes em %.3f s: goodput %.1f Mbit/s\n", (unsigned long long) total, secs,
+        total * 8 / secs / 1e6);
+    printf("[BULK] pacotes: %u, enviados %llu, retransmitidos %llu (%.2f%%), descartados (BULK_LOSS) %llu, RTOs %llu\n",
+        b.npk, (unsigned long long) b.sent, (unsigned long long) b.retrans, 100.0 * b.retrans / b.npk,
+        (unsigned long long) b.dropped, (unsigned long long) b.rtos);
+    printf("[BULK] cwnd final %.0f pacotes, SRTT %.0f us, RTO %llu us\n", b.cwnd, b.srtt, (unsigned long long) b.rto);
+    int ok = done && done_bytes == total && done_sum == expect;
+    printf("[BULK] integridade: %s\n", ok ? "OK" : "FALHOU");
+    free(b.st); free(b.lost); close(b.s);
+    return ok ? 0 : 1;
+}
+
+/* ===========================
+ * Modo mrecv (receptor multicast)
+ * =========================== */
+#define MRECV_NACK_US  20000  // reenvia o NACK de uma faixa após 20 ms sem reparo
+#define MRECV_TRIES    5      // depois disso a mensagem conta como perdida
+#define MRECV_MAX_MISS 65536  // buracos maiores contam direto como perdidos
+
+typedef struct { uint64_t seq, nack_at; int tries; } miss_t;
+
+typedef struct {
+    miss_t *m; size_t n, cap;                   // sequências faltando, em ordem crescente
+    uint64_t next;                              // próxima sequência esperada (0 = ainda não sincronizou)
+    uint64_t received, repaired, lost, dups;
+} mrecv_t;
+
+static void miss_add(mrecv_t *r, uint64_t from, uint64_t to, uint64_t now) {
+    if (to - from > MRECV_MAX_MISS) { r->lost += to - from - MRECV_MAX_MISS; from = to - MRECV_MAX_MISS; }
+    for (uint64_t q = from; q < to; q++) {
+        if (r->n == r->cap) {
+            r->cap = r->cap ? r->cap * 2 : 1024;
+            r->m = (miss_t *) realloc(r->m, r->cap * sizeof *r->m);
+        }
+        r->m[r->n++] = (miss_t) { q, now + MRECV_NACK_US / 4, 0 };  // espera um pouco: pode ser só reordenação
+    }
+}
+
+static long miss_find(const mrecv_t *r, uint64_t seq) {
+    size_t lo = 0, hi = r->n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (r->m[mid].seq < seq) lo = mid + 1; else hi = mid;
+    }
+    return lo < r->n && r->m[lo].seq == seq ? (long) lo : -1;
+}
+
+static void miss_del(mrecv_t *r, size_t i) {
+    memmove(&r->m[i], &r->m[i + 1], (r->n - i - 1) * sizeof *r->m);
+    r->n--;
+}
+
+// Uma mensagem (do grupo ou reparo) chegou
+static void mrecv_on_seq(mrecv_t *r, uint64_t seq, int repair, uint64_t now) {
+    if (!r->next) r->next = seq;  // entrou agora: não pede o histórico
+    if (seq >= r->next) {
+        if (seq > r->next) miss_add(r, r->next, seq, now);
+        r->next = seq + 1;
+        r->received++;
+        return;
+    }
+    long i = miss_find(r, seq);
+    if (i < 0) { r->dups++; return; }
+    miss_del(r, (size_t) i);
+    if (repair) r->repaired++; else r->received++;
+}
+
+// Pede as faixas vencidas em um único NACK; desiste das que esgotaram as tentativas
+static void mrecv_nack(mrecv_t *r, int s, const struct sockaddr_in *pub, uint64_t now) {
+    char pkt[sizeof(mc_hdr_t) + 4 + MCAST_MAX_NACK * 12];
+    uint32_t nr = 0;
+    char *p = pkt + sizeof(mc_hdr_t) + 4;
+    for (size_t i = 0; i < r->n && nr < MCAST_MAX_NACK;) {
+        miss_t *e = &r->m[i];
+        if (e->nack_at > now) { i++; continue; }
+        if (e->tries >= MRECV_TRIES) { r->lost++; miss_del(r, i); continue; }
+        // Faixa de sequências consecutivas vencidas
+        size_t j = i;
+        while (j + 1 < r->n && r->m[j + 1].seq == r->m[j].seq + 1 && r->m[j + 1].nack_at <= now &&
+               r->m[j + 1].tries < MRECV_TRIES) j++;
+        mc_put64(p, e->seq);
+        uint32_t n = htonl((uint32_t) (j - i + 1)); memcpy(p + 8, &n, 4);
+        p += 12; nr++;
+        for (size_t k = i; k <= j; k++) { r->m[k].tries++; r->m[k].nack_at = now + MRECV_NACK_US; }
+        i = j + 1;
+    }
+    if (!nr) return;
+    mc_hdr((mc_hdr_t *) pkt, MC_NACK, (uint16_t) (p - pkt - sizeof(mc_hdr_t)), 0);
+    uint32_t nbe = htonl(nr); memcpy(pkt + sizeof(mc_hdr_t), &nbe, 4);
+    sendto(s, pkt, (size_t) (p - pkt), 0, (const struct sockaddr *) pub, sizeof *pub);
+}
+
+static int run_mrecv(const char *group, int gport, const char *pub_ip, int pub_port, int secs) {
+    // Socket do grupo (SO_REUSEADDR: vários receptores na mesma máquina)
+    int g = socket(AF_INET, SOCK_DGRAM, 0);
+    int one = 1, sz = 4 << 20;
+    setsockopt(g, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    setsockopt(g, SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    struct sockaddr_in any = { .sin_family = AF_INET, .sin_port = htons(gport), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(g, (struct sockaddr *) &any, sizeof any) < 0) { perror("[MRECV] bind"); return 1; }
+    struct ip_mreq mreq = { .imr_interface = mc_iface() };
+    if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1 ||
+        setsockopt(g, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof mreq) < 0) {
+        perror("[MRECV] IP_ADD_MEMBERSHIP"); return 1;
+    }
+    // Socket próprio para NACK/reparos (a porta do grupo é compartilhada entre receptores)
+    int u = socket(AF_INET, SOCK_DGRAM, 0);
+    setsockopt(u, SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    struct sockaddr_in pub = { .sin_family = AF_INET, .sin_port = htons(pub_port) };
+    if (inet_pton(AF_INET, pub_ip, &pub.sin_addr) != 1) { fprintf(stderr, "[MRECV] IP invalido: %s\n", pub_ip); return 1; }
+
+    const char *v = getenv("MCAST_LOSS");
+    double loss = v ? atof(v) : 0;
+    srand48(getpid());
+    mrecv_t r = { 0 };
+    uint64_t dropped = 0;
+    uint64_t t0 = bulk_now_us(), end = t0 + (uint64_t) secs * 1000000;
+    char buf[sizeof(mc_hdr_t) + MCAST_MAX];
+    printf("[MRECV] no grupo %s:%d por %d s\n", group, gport, secs);
+    // Ao fim do prazo, para de aceitar mensagens novas e espera só os reparos pendentes
+    uint64_t drain_end = end + (uint64_t) MRECV_NACK_US * MRECV_TRIES;
+    for (uint64_t now = t0; now < end || (r.n && now < drain_end); now = bulk_now_us()) {
+        struct pollfd pfd[2] = { { .fd = g, .events = POLLIN }, { .fd = u, .events = POLLIN } };
+        poll(pfd, 2, 5);
+        now = bulk_now_us();
+        for (int k = 0; k < 2; k++) {
+            if (!(pfd[k].revents & POLLIN)) continue;
+            for (int it = 0; it < 256; it++) {
+                ssize_t n = recv(pfd[k].fd, buf, sizeof buf, MSG_DONTWAIT);
+                if (n < (ssize_t) sizeof(mc_hdr_t)) break;
+                mc_hdr_t h; memcpy(&h, buf, sizeof h);
+                if (h.magic != MCAST_MAGIC) continue;
+                uint64_t seq = mc_get64((const char *) &h.seq);
+                if (now >= end && h.type != MC_REPAIR && h.type != MC_GONE) continue;
+                if (h.type == MC_DATA) {
+                    if (loss > 0 && drand48() < loss) { dropped++; continue; }  // perda simulada
+                    mrecv_on_seq(&r, seq, 0, now);
+                } else if (h.type == MC_REPAIR) {
+                    mrecv_on_seq(&r, seq, 1, now);
+                } else if (h.type == MC_HB && r.next && seq >= r.next) {  // perdas no fim do fluxo
+                    miss_add(&r, r.next, seq + 1, now);
+                    r.next = seq + 1;
+                } else if (h.type == MC_GONE && n >= (ssize_t) sizeof h + 4) {
+                    uint32_t cnt = mc_get32(buf + sizeof h);
+                    for (uint64_t q = seq; q < seq + cnt; q++) {
+                        long i = miss_find(&r, q);
+                        if (i >= 0) { miss_del(&r, (size_t) i); r.lost++; }
+                    }
+                }
+            }
+        }
+        mrecv_nack(&r, u, &pub, now);
+    }
+    r.lost += r.n;  // ainda faltando ao final
+    double secs_el = (end - t0) / 1e6;
+    printf("[MRECV] recebidas %llu, reparadas %llu, perdidas %llu, duplicadas %llu (descartadas por MCAST_LOSS %llu)\n",
+        (unsigned long long) r.received, (unsigned long long) r.repaired, (unsigned long long) r.lost,
+        (unsigned long long) r.dups, (unsigned long long) dropped);
+    printf("[MRECV] %.0f msgs/s entregues\n", (r.received + r.repaired) / secs_el);
+    free(r.m); close(g); close(u);
+    return r.lost ? 1 : 0;
+}
+
+/* ===========================
+ * Modo big (mensagens grandes no tcp_server)
+ * =========================== */
+#define BIG_TOTAL (1ull << 30)   // bytes ecoados por medição (tamanho x modo)
+#define BIG_RCHUNK (1 << 20)
+
+typedef struct { int s; const char *body; size_t size; int count; const char *mode; int err; } big_job_t;
+
+static int send_all(int s, const char *p, size_t n) {
+    while (n) {
+        ssize_t r = send(s, p, n, MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r; n -= (size_t) r;
+    }
+    return 0;
+}
+
+// Escritor: envia cabeçalho + corpo de cada mensagem enquanto a thread principal lê o eco
+// (ler e escrever ao mesmo tempo evita o impasse com os buffers dos dois lados cheios)
+static void *big_writer(void *p) {
+    big_job_t *b = (big_job_t *) p;
+    char hdr[64];
+    for (int i = 0; i < b->count; i++) {
+        int n = snprintf(hdr, sizeof hdr, "BIG %zu %s\n", b->size, b->mode);
+        if (send_all(b->s, hdr, (size_t) n) < 0 || send_all(b->s, b->body, b->size) < 0) { b->err = 1; break; }
+    }
+    return NULL;
+}
+
+// count mensagens de size bytes no modo pedido; devolve MB/s do eco (conferido byte a byte) ou -1
+static double big_measure(int s, const char *body, size_t size, int count, const char *mode, char *rbuf) {
+    big_job_t job = { s, body, size, count, mode, 0 };
+    pthread_t th;
+    uint64_t t0 = bulk_now_us();
+    pthread_create(&th, NULL, big_writer, &job);
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++) {
+        char line[128]; size_t n = 0;
+        while (n < sizeof line - 1 && recv(s, line + n, 1, 0) == 1 && line[n++] != '\n') {}
+        line[n] = '\0';
+        char *eco = strstr(line, "eco: ");
+        if (!eco || strtoull(eco + 5, NULL, 10) != size) { fprintf(stderr, "[BIG] resposta inválida: %s\n", line); ok = 0; break; }
+        for (size_t off = 0; off < size; ) {
+            size_t want = size - off < BIG_RCHUNK ? size - off : BIG_RCHUNK;
+            ssize_t r = recv(s, rbuf, want, MSG_WAITALL);
+            if (r <= 0) { perror("[BIG] recv"); ok = 0; break; }
+            if (memcmp(rbuf, body + off, (size_t) r) != 0) { fprintf(stderr, "[BIG] eco diferente no byte %zu\n", off); ok = 0; break; }
+            off += (size_t) r;
+        }
+    }
+    if (!ok) shutdown(s, SHUT_RDWR);  // destrava o escritor
+    pthread_join(th, NULL);
+    double secs = (bulk_now_us() - t0) / 1e6;
+    return ok && !job.err ? (double) size * count / secs / 1e6 : -1;
+}
+
+// Compara copy/splice/zerocopy de 64 KB a 16 MB (ou só TAM_KB / MODO) em uma conexão
+static int run_big(const char *ip, int port, size_t only_kb, const char *only_mode) {
+    static const size_t sizes_kb[] = { 64, 256, 1024, 4096, 16384 };
+    static const char *modes[] = { "copy", "splice", "zerocopy" };
+    size_t maxsz = only_kb ? only_kb << 10 : sizes_kb[4] << 10;
+
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in srv = { 0 };
+    srv.sin_family = AF_INET; srv.sin_port = htons(port);
+    if (s < 0 || inet_pton(AF_INET, ip, &srv.sin_addr) != 1 || connect(s, (struct sockaddr *) &srv, sizeof srv) < 0) {
+        perror("[BIG] connect"); return 1;
+    }
+    char *body = (char *) malloc(maxsz), *rbuf = (char *) malloc(BIG_RCHUNK);
+    for (size_t i = 0; i < maxsz; i++) body[i] = (char) (i * 131 + (i >> 12));
+    // Aquecimento: o servidor só atende depois do accept (que tem um sleep de 1 s)
+    if (big_measure(s, body, 1, 1, "copy", rbuf) < 0) return 1;
+
+    printf("[BIG] %10s", "tamanho");
+    for (int m = 0; m < 3; m++) if (!only_mode || !strcmp(only_mode, modes[m])) printf(" %10s", modes[m]);
+    printf("   (MB/s do eco)\n");
+    for (int k = 0; k < 5; k++) {
+        size_t kb = only_kb ? only_kb : sizes_kb[k];
+        printf("[BIG] %7zu KB", kb);
+        for (int m = 0; m < 3; m++) {
+            if (only_mode && strcmp(only_mode, modes[m])) continue;
+            size_t size = kb << 10;
+            int count = (int) (BIG_TOTAL / size < 4 ? 4 : BIG_TOTAL / size);
+            double mbs = big_measure(s, body, size, count, modes[m], rbuf);
+            if (mbs < 0) { printf("\n"); return 1; }
+            printf(" %10.1f", mbs);
+            fflush(stdout);
+        }
+        printf("\n");
+        if (only_kb) break;
+    }
+    free(body); free(rbuf); close(s);
+    return 0;
+}
+
+/* ===========================
+ * Modo flood (eco em lote contra o modo offload)
+ * =========================== */
+#define FLOOD_STALL_US 200000  // sem ecos há 200 ms: considera perdido o que estava em voo
+
+static int run_flood(const char *ip, int port, int secs, size_t size) {
+    if (size < 1 || size > 8192) { fprintf(stderr, "[FLOOD] TAM deve estar entre 1 e 8192\n"); return 1; }
+    const char *v = getenv("FLOOD_WINDOW");
+    long window = v ? atol(v) : 1024;
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in srv = { 0 };
+    srv.sin_family = AF_INET; srv.sin_port = htons(port);
+    if (s < 0 || inet_pton(AF_INET, ip, &srv.sin_addr) != 1) { fprintf(stderr, "[FLOOD] IP inválido: %s\n", ip); return 1; }
+    int sz = 8 << 20;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    setsockopt(s, SOL_SOCKET, SO_SNDBUF, &sz, sizeof sz);
+    uoff_rx_t *rx = uoff_rx_new(s, uoff_wanted());
+    uoff_tx_t *tx = uoff_tx_new(s, uoff_wanted());
+    char *msg = (char *) malloc(size);
+    if (!rx || !tx || !msg) { perror("[FLOOD] malloc"); return 1; }
+    memset(msg, 'F', size);
+    printf("[FLOOD] %s:%d, %zu bytes, janela %ld, GRO %s, GSO %s\n", ip, port, size, window,
+        rx->gro ? "ligado" : "desligado", tx->gso ? "ligado" : "desligado");
+
+    uint64_t got = 0, bad = 0, lost = 0;
+    long inflight = 0;
+    uint64_t cpu0 = uoff_cpu_us(), t0 = bulk_now_us(), end = t0 + (uint64_t) secs * 1000000, last_rx = t0;
+    for (uint64_t now = t0; ; now = bulk_now_us()) {
+        int sending = now < end;
+        if (!sending && (inflight == 0 || now - last_rx > FLOOD_STALL_US)) break;
+        // Completa a janela: as mensagens vão para o lote e saem em sendmmsg (ou UDP_SEGMENT)
+        for (; sending && inflight < window; inflight++) uoff_tx_add(tx, s, &srv, msg, size);
+        uoff_tx_flush(tx, s);
+
+        struct pollfd pfd = { .fd = s, .events = POLLIN };
+        if (poll(&pfd, 1, 10) > 0) {
+            int n;
+            while ((n = uoff_rx_recv(rx, s, MSG_DONTWAIT)) > 0) {
+                for (int i = 0; i < n; i++) {
+                    size_t len = rx->msg[i].msg_len, seg = uoff_rx_seg(rx, i);
+                    for (size_t off = 0; off < len; off += seg) {
+                        size_t m = len - off < seg ? len - off : seg;
+                        rx->pkts++;
+                        if (m == size) got++; else bad++;
+                        if (inflight > 0) inflight--;
+                    }
+                }
+                last_rx = bulk_now_us();
+                if (n < UOFF_BATCH) break;
+            }
+        }
+        if (inflight > 0 && bulk_now_us() - last_rx > FLOOD_STALL_US) {
+            lost += (uint64_t) inflight;  // datagramas ou ecos descartados: reabre a janela
+            inflight = 0;
+            last_rx = bulk_now_us();
+        }
+    }
+    double el = (bulk_now_us() - t0) / 1e6, cpu = (double) (uoff_cpu_us() - cpu0);
+    uint64_t pkts = tx->pkts + rx->pkts;
+    printf("[FLOOD] %llu enviados em %llu sendmmsg, %llu ecos em %llu recvmmsg (%llu buffers), "
+        "%llu inválidos, %llu truncados, ~%llu perdidos\n",
+        (unsigned long long) tx->pkts, (unsigned long long) tx->calls, (unsigned long long) got,
+        (unsigned long long) rx->calls, (unsigned long long) rx->bufs, (unsigned long long) bad,
+        (unsigned long long) rx->trunc, (unsigned long long) lost);
+    printf("[FLOOD] %.0f ecos/s (%.1f MB/s), CPU do cliente %.0f ns por pacote (envio + recebimento)\n",
+        got / el, got * size / el / 1e6, pkts ? cpu * 1000 / pkts : 0.0);
+    uoff_rx_free(rx); uoff_tx_free(tx); free(msg); close(s);
+    return got ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
+    if (argc >= 4 && argc <= 6 && strcmp(argv[1], "big") == 0)
+        return run_big(argv[2], atoi(argv[3]), argc > 4 ? strtoull(argv[4], NULL, 10) : 0, argc > 5 ? argv[5] : NULL);
+    if (argc == 5 && strcmp(argv[1], "bulk") == 0)
+        return run_bulk(argv[2], atoi(argv[3]), strtoull(argv[4], NULL, 10) << 20);
+    if (argc == 7 && strcmp(argv[1], "mrecv") == 0)
+        return run_mrecv(argv[2], atoi(argv[3]), argv[4], atoi(argv[5]), atoi(argv[6]));
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "flood") == 0)
+        return run_flood(argv[2], atoi(argv[3]), atoi(argv[4]), argc > 5 ? (size_t) atoi(argv[5]) : 256);
+
     // Verifica se tem argumentos suficientes
     if (argc < 6) {
-        fprintf(stderr, "uso: %s tcp|udp IP PORTA N \"MSG\"\n", argv[0]);
+        fprintf(stderr, "uso: %s tcp|udp IP PORTA N \"MSG\" [--hedge] [--retries N]\n       %s bulk IP PORTA MB\n"
+            "       %s mrecv GRUPO PORTA_GRUPO IP_PUB PORTA_PUB SEGUNDOS\n       %s big IP PORTA [TAM_KB] [copy|splice|zerocopy]\n"
+            "       %s flood IP PORTA SEGUNDOS [TAM]\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
 
@@ -142,6 +838,16 @@ int main(int argc, char **argv) {
     const char *base = argv[5];                 // Mensagem base
 
     if (N <= 0) { fprintf(stderr, "N deve ser > 0\n"); return 1; }
+    for (int i = 6; i < argc; i++) {
+        if (!strcmp(argv[i], "--hedge")) udp_hedge = 1;
+        else if (!strcmp(argv[i], "--retries") && i + 1 < argc) udp_retries = atoi(argv[++i]);
+        else { fprintf(stderr, "opção desconhecida: %s\n", argv[i]); return 1; }
+    }
+    const char *loss = getenv("UDP_LOSS");
+    udp_loss = loss ? atof(loss) : 0;
+    udp_corr_base = (uint32_t) getpid() << 16 ^ (uint32_t) bulk_now_us();
+    udp_lat = (uint64_t *) calloc((size_t) N, sizeof *udp_lat);
+    udp_ok = (int *) calloc((size_t) N, sizeof *udp_ok);
 
     // Aloca array de handles para as threads
     pthread_t *th = (pthread_t *)malloc(sizeof(pthread_t) * N);
@@ -167,6 +873,8 @@ int main(int argc, char **argv) {
 
     // Espera todas as threads terminarem
     for (int i = 0; i < N; i++) pthread_join(th[i], NULL);
+    if (is_udp) udp_summary(N);
+    free(udp_lat); free(udp_ok);
     free(th);        // Libera array de handles
     return 0;
 }
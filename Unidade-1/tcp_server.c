@@ -2,7 +2,10 @@
 #define _GNU_SOURCE 
 #include <arpa/inet.h> // Funções de conversão de endereços
 #include <errno.h> 
+#include <fcntl.h> // splice, pipes
+#include <linux/errqueue.h> // Notificações de conclusão do MSG_ZEROCOPY
 #include <netinet/in.h> // Definições de estruturas de endereços
+#include <poll.h>
 #include <pthread.h> // Biblioteca para threads POSIX
 #include <signal.h>
 #include <stdio.h>
@@ -12,8 +15,16 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "../comum/alog.h" // Logger assíncrono (ring buffer por thread)
+#include "../comum/trace.h" // Trace de fases por requisição (dump com SIGUSR1)
+#include "../comum/ratelimit.h" // Limite de taxa por IP e teto de requisições em andamento
+
 #define BACKLOG 64  // Máximo de conexões pendentes na fila
 #define BUFSZ   1024  // Tamanho do buffer para mensagens
+#define BIG_MAX   (1ull << 30)  // Maior mensagem BIG aceita
+#define BIG_CHUNK (1 << 20)     // Bloco dos modos copy/splice (capacidade pedida ao pipe)
+#define ZC_CHUNK  (256 << 10)   // Bloco do modo zerocopy
+#define ZC_SLOTS  8             // Buffers em voo no modo zerocopy
 
 /*
  * Servidor TCP multi-thread
@@ -22,50 +33,262 @@
  * - Cada thread recebe uma mensagem, simula processamento demorado (sleep) e responde ao cliente com eco e ID da thread.
  * - Permite múltiplos clientes simultâneos, evidenciando concorrência.
  * - Encerramento via Ctrl+C
+ * - Controle de admissão logo após o accept (../comum/ratelimit.h): clientes acima do limite
+ *   por IP ou com o servidor no teto de conexões recebem "BUSY" e a conexão é fechada,
+ *   sem criar thread.
+ * - Mensagens grandes: se a conexão começa com "BIG <tamanho> [modo]\n" (detectado com
+ *   MSG_PEEK), o corpo é devolvido sem o sleep, precedido de um cabeçalho curto, e a conexão
+ *   aceita outras mensagens BIG até o cliente fechar. Modos (padrão em TCP_BIG_MODE):
+ *     copy      recv para um buffer, cópia para o buffer de saída, send (2 cópias no usuário)
+ *     splice    socket -> pipe -> socket com splice (os bytes não passam pelo usuário)
+ *     zerocopy  recv para um anel de buffers + send com MSG_ZEROCOPY; o buffer só é
+ *               reutilizado depois da notificação de conclusão (fila de erros do socket)
  *
  * Uso:
  *   ./tcp_server <PORTA>
  *
  * Exemplo:
  *   ./tcp_server 6000
+ *   RL_RATE=5 RL_BURST=10 RL_MAX_INFLIGHT=100 ./tcp_server 6000
+ *   TCP_BIG_MODE=zerocopy ./tcp_server 6000
  */
 
 // Estrutura para passar dados para cada thread (contexto da conexão)
-typedef struct { int cfd; struct sockaddr_in caddr; } ctx_t;
+typedef struct { int cfd; struct sockaddr_in caddr; trace_t tr; } ctx_t;
 static volatile sig_atomic_t running = 1;  // Controla se o servidor continua rodando (tipo seguro para sinais)
 
+/* ===========================
+ * Mensagens grandes (BIG)
+ * =========================== */
+enum { BIG_COPY = 0, BIG_SPLICE, BIG_ZEROCOPY };
+static const char *big_names[] = { "copy", "splice", "zerocopy" };
+static int big_default = BIG_SPLICE;
+
+// Estado de uma conexão BIG (buffers e pipe criados sob demanda e reaproveitados)
+typedef struct {
+    int cfd;
+    char *in, *out;             // copy
+    int pfd[2]; int pipe_sz;    // splice
+    char *zc; int zc_on;        // zerocopy: anel de ZC_SLOTS x ZC_CHUNK
+    uint32_t zc_next;           // id da próxima chamada send com MSG_ZEROCOPY
+    uint32_t zc_slot_id[ZC_SLOTS];
+    uint64_t zc_done, zc_copied;  // ids concluídos / concluídos com cópia (ex.: loopback)
+} big_t;
+
+static ssize_t big_send_all(int fd, const char *p, size_t n, int flags) {
+    size_t sent = 0;
+    while (sent < n) {
+        ssize_t r = send(fd, p + sent, n - sent, flags | MSG_NOSIGNAL);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        sent += (size_t) r;
+    }
+    return (ssize_t) sent;
+}
+
+// Caminho com cópias: kernel -> in -> out -> kernel
+static int big_copy(big_t *b, size_t len) {
+    if (!b->in) {
+        // Os dois buffers entram juntos: nunca fica `in` sem `out`
+        char *in = malloc(BIG_CHUNK), *out = malloc(BIG_CHUNK);
+        if (!in || !out) { free(in); free(out); return -1; }
+        b->in = in; b->out = out;
+    }
+    while (len) {
+        ssize_t n = recv(b->cfd, b->in, len < BIG_CHUNK ? len : BIG_CHUNK, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        memcpy(b->out, b->in, (size_t) n);
+        if (big_send_all(b->cfd, b->out, (size_t) n, 0) < 0) return -1;
+        len -= (size_t) n;
+    }
+    return 0;
+}
+
+// Caminho com splice: os bytes vão do socket para o pipe e do pipe de volta ao socket
+static int big_splice(big_t *b, size_t len) {
+    if (b->pipe_sz == 0) {
+        if (pipe(b->pfd) < 0) return -1;
+        fcntl(b->pfd[1], F_SETPIPE_SZ, BIG_CHUNK);  // sem privilégio, vale até /proc/sys/fs/pipe-max-size
+        b->pipe_sz = fcntl(b->pfd[1], F_GETPIPE_SZ);
+        if (b->pipe_sz <= 0) b->pipe_sz = 65536;
+    }
+    while (len) {
+        size_t want = len < (size_t) b->pipe_sz ? len : (size_t) b->pipe_sz;
+        ssize_t n = splice(b->cfd, NULL, b->pfd[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len -= (size_t) n;
+        // Esvazia o pipe inteiro antes da próxima leitura: o splice de entrada nunca bloqueia por pipe cheio
+        while (n > 0) {
+            ssize_t m = splice(b->pfd[0], NULL, b->cfd, NULL, (size_t) n, SPLICE_F_MOVE | (len ? SPLICE_F_MORE : 0));
+            if (m < 0 && errno == EINTR) continue;
+            if (m <= 0) return -1;
+            n -= m;
+        }
+    }
+    return 0;
+}
+
+// Lê as notificações de conclusão do MSG_ZEROCOPY até `upto` chamadas estarem concluídas
+static int big_zc_wait(big_t *b, uint64_t upto) {
+    while (b->zc_done < upto) {
+        struct pollfd pfd = { .fd = b->cfd, .events = 0 };  // POLLERR: fila de erros não vazia
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return -1;
+        char ctrl[128];
+        struct msghdr msg = { .msg_control = ctrl, .msg_controllen = sizeof ctrl };
+        if (recvmsg(b->cfd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) continue;
+            // Fila vazia com a conexão caída: o poll voltaria na hora para sempre
+            if (errno == EAGAIN && !(pfd.revents & (POLLHUP | POLLNVAL))) continue;
+            return -1;
+        }
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *ee = (struct sock_extended_err *) CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // Faixa [ee_info, ee_data] de chamadas concluídas (no TCP chegam em ordem)
+            uint64_t n = (uint32_t) (ee->ee_data - ee->ee_info) + 1ull;
+            b->zc_done += n;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) b->zc_copied += n;
+        }
+    }
+    return 0;
+}
+
+// ENOBUFS no send: com envios zerocopy pendentes, espera o próximo concluir (libera memória
+// travada); sem nenhum pendente não há notificação a esperar, então recua com poll(POLLOUT)
+static int big_nobufs(big_t *b) {
+    if (b->zc_on && b->zc_done < b->zc_next) return big_zc_wait(b, b->zc_done + 1);
+    struct pollfd pfd = { .fd = b->cfd, .events = POLLOUT };
+    if (poll(&pfd, 1, 10) < 0 && errno != EINTR) return -1;
+    return pfd.revents & (POLLERR | POLLHUP | POLLNVAL) ? -1 : 0;
+}
+
+// Caminho com MSG_ZEROCOPY: uma cópia na entrada (recv), o envio referencia o buffer do usuário
+static int big_zerocopy(big_t *b, size_t len) {
+    if (!b->zc) {
+        int one = 1;
+        if (setsockopt(b->cfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof one) == 0) b->zc_on = 1;
+        else alog_txt(ALOG_WARN, "[TCP] SO_ZEROCOPY indisponível, usando send comum\n");
+        if (!(b->zc = malloc((size_t) ZC_SLOTS * ZC_CHUNK))) return -1;
+    }
+    while (len) {
+        int slot = (int) (b->zc_next % ZC_SLOTS);
+        // O buffer do slot ainda pode estar referenciado pelo kernel: espera a conclusão do último envio dele
+        if (b->zc_on && b->zc_slot_id[slot] && big_zc_wait(b, b->zc_slot_id[slot]) < 0) return -1;
+        char *buf = b->zc + (size_t) slot * ZC_CHUNK;
+        ssize_t n = recv(b->cfd, buf, len < ZC_CHUNK ? len : ZC_CHUNK, MSG_WAITALL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len -= (size_t) n;
+        for (ssize_t off = 0; off < n; ) {
+            ssize_t r = send(b->cfd, buf + off, (size_t) (n - off), MSG_NOSIGNAL | (b->zc_on ? MSG_ZEROCOPY : 0));
+            if (r < 0 && (errno == EINTR || errno == ENOBUFS)) {  // ENOBUFS: limite de memória travada
+                if (errno == ENOBUFS && big_nobufs(b) < 0) return -1;
+                continue;
+            }
+            if (r <= 0) return -1;
+            off += r;
+            if (b->zc_on) b->zc_next++;
+        }
+        b->zc_slot_id[slot] = b->zc_next;  // concluído quando zc_done >= este total
+        if (!b->zc_on) b->zc_next++;
+    }
+    return 0;
+}
+
+// Atende mensagens "BIG <tamanho> [modo]\n" até o cliente fechar; devolve as mensagens atendidas
+static int big_serve(ctx_t *ctx) {
+    big_t b = { .cfd = ctx->cfd, .pfd = { -1, -1 } };
+    int count = 0;
+    for (;;) {
+        // Linha de cabeçalho lida byte a byte (curta; o corpo vem em blocos grandes)
+        char line[64]; size_t n = 0;
+        while (n < sizeof line - 1) {
+            ssize_t r = recv(ctx->cfd, line + n, 1, 0);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) goto out;
+            if (line[n++] == '\n') break;
+        }
+        line[n] = '\0';
+        unsigned long long len; char mode[16] = "";
+        if (sscanf(line, "BIG %llu %15s", &len, mode) < 1 || len > BIG_MAX) {
+            alog_str(ALOG_WARN, "[TCP] cabeçalho BIG inválido: %.*s\n", line, n);
+            break;
+        }
+        int m = big_default;
+        for (int i = 0; i < 3; i++) if (strcmp(mode, big_names[i]) == 0) m = i;
+
+        // Só o cabeçalho da resposta é montado no espaço do usuário
+        char hdr[96];
+        int hn = snprintf(hdr, sizeof hdr, "OK TCP thr=%lu eco: %llu bytes (%s)\n",
+            (unsigned long) pthread_self(), len, big_names[m]);
+        if (big_send_all(ctx->cfd, hdr, (size_t) hn, MSG_MORE) < 0) break;
+        int rc = m == BIG_COPY ? big_copy(&b, len) : m == BIG_SPLICE ? big_splice(&b, len) : big_zerocopy(&b, len);
+        if (rc < 0) { alog_peer(ALOG_WARN, "[TCP] erro no eco BIG para %s:%d\n", &ctx->caddr); break; }
+        count++;
+    }
+out:
+    if (b.zc_on) {
+        big_zc_wait(&b, b.zc_next);  // os buffers só podem ser liberados depois da última conclusão
+        if (b.zc_copied)
+            alog_num(ALOG_INFO, "[TCP] zerocopy: %llu envios copiados pelo kernel (ex.: loopback)\n", b.zc_copied);
+    }
+    if (b.pipe_sz) { close(b.pfd[0]); close(b.pfd[1]); }
+    free(b.in); free(b.out); free(b.zc);
+    return count;
+}
+
 // Função que cada thread executa para atender um cliente
 static void *worker(void *p) {
     ctx_t *ctx = (ctx_t *) p;
-    char ip[INET_ADDRSTRLEN];
-    // Converte o endereço IP do cliente para string legível
-    inet_ntop(AF_INET, &ctx->caddr.sin_addr, ip, sizeof ip);
-    int cport = ntohs(ctx->caddr.sin_port);  // Extrai a porta do cliente com ntohs()
-    fprintf(stderr, "[TCP] conexão %s:%d\n", ip, cport);
+    trace_mark(&ctx->tr, "dispatch");  // Espera até a thread começar a rodar
+    // O endereço é gravado em binário; inet_ntop/ntohs ficam para a thread do logger
+    alog_peer(ALOG_INFO, "[TCP] conexão %s:%d\n", &ctx->caddr);
 
     char buf[BUFSZ];
+    // Mensagem grande? Espia o início sem consumir
+    if (recv(ctx->cfd, buf, 4, MSG_PEEK) == 4 && memcmp(buf, "BIG ", 4) == 0) {
+        trace_mark(&ctx->tr, "recv");
+        int count = big_serve(ctx);
+        trace_mark(&ctx->tr, "send");
+        trace_commit(&ctx->tr);
+        alog_num(ALOG_INFO, "[TCP] fim da conexão BIG: %llu mensagens\n", (unsigned long long) count);
+        close(ctx->cfd);
+        free(ctx);
+        rl_done();
+        return NULL;
+    }
+
     // Recebe dados do cliente
     ssize_t n = recv(ctx->cfd, buf, BUFSZ - 1, 0);
+    trace_mark(&ctx->tr, "recv");
 
     if (n <= 0) {  // Se não recebeu dados ou erro
+        trace_commit(&ctx->tr);
         close(ctx->cfd);
         free(ctx);
+        rl_done();
         return NULL;
     }
     buf[n] = '\0';  // Termina a string
-    fprintf(stderr, "[TCP] recebido de %s:%d: %s\n", ip, cport, buf);
+    alog_peer_str(ALOG_INFO, "[TCP] recebido de %s:%d: %.*s\n", &ctx->caddr, buf, (size_t) n);
     sleep(1);  
-    fprintf(stderr, "[TCP] processando %s:%d...\n", ip, cport);
+    alog_peer(ALOG_INFO, "[TCP] processando %s:%d...\n", &ctx->caddr);
     sleep(5);  // Simula processamento demorado
+    trace_mark(&ctx->tr, "process");
 
     // Prepara resposta de eco com ID da thread
     char out[BUFSZ]; snprintf(out, sizeof out, "OK TCP thr=%lu eco: %s",
         (unsigned long) pthread_self(), buf);
         
     send(ctx->cfd, out, strlen(out), 0);  // Envia resposta no soket dedicado (cfd)
+    trace_mark(&ctx->tr, "send");
+    trace_commit(&ctx->tr);  // Guarda no flight recorder
     close(ctx->cfd); // Fecha a conexão com o cliente
+    alog_peer(ALOG_INFO, "[TCP] fim %s:%d\n", &ctx->caddr);
     free(ctx);  // Limpa recursos
-    fprintf(stderr, "[TCP] fim %s:%d\n", ip, cport);
+    rl_done();  // Libera a vaga no teto de requisições em andamento
     return NULL;
 }
 
@@ -82,6 +305,8 @@ int main(int argc, char **argv) {
         return 1;
     }
     int port = atoi(argv[1]);
+    const char *bm = getenv("TCP_BIG_MODE");
+    for (int i = 0; bm && i < 3; i++) if (strcmp(bm, big_names[i]) == 0) big_default = i;
     
     // Configura handler para Ctrl+C usando sigaction (mais robusto em multi-thread)
     struct sigaction sa;
@@ -120,6 +345,10 @@ int main(int argc, char **argv) {
         return 1;
     }
     fprintf(stderr, "[TCP] escutando 0.0.0.0:%d\n", port);
+    if (trace_init("tcp") < 0 || alog_init() < 0 || rl_init() < 0) {
+        fprintf(stderr, "[TCP] falha ao iniciar logger/trace/limitador\n");
+        return 1;
+    }
 
     // Loop principal: aceita conexões enquanto running = 1
     while (running) {
@@ -127,6 +356,7 @@ int main(int argc, char **argv) {
         struct sockaddr_in c; socklen_t cl = sizeof c;
         // Aceita nova conexão (bloqueia até chegada de cliente)
         int cfd = accept(sfd, (struct sockaddr *) &c, &cl); // accept() é a função que recebe/aceita a conexão TCP
+        uint64_t t_acc = trace_now();
 
         if (cfd < 0) {
             if (errno == EINTR) break;  // Interrompido por sinal
@@ -134,9 +364,18 @@ int main(int argc, char **argv) {
             continue;
         }
 
+        // Admissão antes de qualquer alocação: recusa barata, sem thread
+        if (rl_admit(&c) != RL_OK) {
+            rl_reject_stream(cfd, "BUSY\n", 5);
+            continue;
+        }
+
         // Cria contexto para a nova conexão
         ctx_t *ctx = malloc(sizeof * ctx);
         ctx->cfd = cfd; ctx->caddr = c;
+        // Início do trace = chegada do cliente (estimada pelo kernel): a fase "accept" é a espera na fila
+        trace_begin_at(&ctx->tr, &c, trace_tcp_arrival(cfd, t_acc));
+        trace_mark(&ctx->tr, "accept");
         
         // Cria thread para atender este cliente
         pthread_t th;
@@ -144,6 +383,9 @@ int main(int argc, char **argv) {
         pthread_detach(th);  // Thread se limpa automaticamente ao terminar
     }
 
-    close(sfd); fprintf(stderr, "[TCP] encerrado\n");
+    close(sfd);
+    alog_shutdown();  // Drena os registros pendentes antes de sair
+    rl_report("[TCP]");
+    fprintf(stderr, "[TCP] encerrado\n");
     return 0;
 }
@@ -0,0 +1,72 @@
+// udp_bulk.h - protocolo de transferência em massa confiável sobre UDP (header-only)
+#ifndef UDP_BULK_H
+#define UDP_BULK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * TRANSFERÊNCIA EM MASSA SOBRE UDP (modo bulk)
+ * - O cliente (multi_client_linux bulk) envia um blob dividido em pacotes numerados;
+ *   o servidor (udp_server <porta> bulk) recebe, confirma e verifica a integridade.
+ * - ACK cumulativo + até BULK_MAX_SACK blocos de ACK seletivo (SACK): o emissor
+ *   retransmite apenas as faixas perdidas.
+ * - O emissor controla a janela (AIMD: slow start, metade na perda), espaça os envios
+ *   (pacing) e calcula o RTO a partir de SRTT/RTTVAR (timestamp ecoado no ACK).
+ * - O receptor não guarda os dados: mantém um bitmap e uma soma de verificação
+ *   independente de ordem (soma dos FNV-1a 64 de cada pacote), comparada no final.
+ *
+ * Pacotes (campos em big-endian), todos com o cabeçalho bulk_hdr_t:
+ *   BULK_START  cliente -> servidor  seq = tamanho do payload (MSS), payload [u64 total_bytes]
+ *               resposta: BULK_ACK com seq = 0
+ *   BULK_DATA   cliente -> servidor  seq = número do pacote, ts = µs do envio, payload = dados
+ *   BULK_ACK    servidor -> cliente  seq = próximo pacote esperado (cumulativo), ts = eco,
+ *               payload [u32 qtd] qtd x ([u32 início][u32 fim)) pacotes recebidos acima do cumulativo
+ *   BULK_DONE   servidor -> cliente  payload [u64 bytes][u64 soma] (repetido se o cliente insistir)
+ */
+
+#define BULK_MAGIC    0xB7
+#define BULK_MSS      1400      // payload padrão por pacote (cabe em MTU 1500 com IP/UDP/cabeçalho)
+#define BULK_MAX_MSS  8192
+#define BULK_MAX_SACK 16
+#define BULK_MAX_MB   4096      // maior transferência aceita pelo receptor (BULK_MAX_MB=N muda)
+
+enum { BULK_START = 1, BULK_DATA = 2, BULK_ACK = 3, BULK_DONE = 4 };
+
+typedef struct {
+    uint8_t magic, type;
+    uint16_t len;    // bytes de payload
+    uint32_t xfer;   // identificador da transferência (escolhido pelo cliente)
+    uint32_t seq;
+    uint32_t ts;
+} __attribute__((packed)) bulk_hdr_t;
+
+static inline uint64_t bulk_now_us(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static inline void bulk_put64(char *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) { p[i] = (char) (v & 0xff); v >>= 8; }
+}
+static inline uint64_t bulk_get64(const char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | (unsigned char) p[i];
+    return v;
+}
+
+// Hash de um pacote (número + dados); a soma dos hashes não depende da ordem de chegada
+static inline uint64_t bulk_hash(uint32_t seq, const char *d, size_t n) {
+    uint64_t h = 1469598103934665603ull;
+    for (int i = 0; i < 4; i++) { h ^= (uint8_t) (seq >> (8 * i)); h *= 1099511628211ull; }
+    for (size_t i = 0; i < n; i++) { h ^= (uint8_t) d[i]; h *= 1099511628211ull; }
+    return h;
+}
+
+// Conteúdo sintético do pacote `seq` (o cliente gera; o servidor só confere a soma)
+static inline void bulk_fill(char *d, size_t n, uint32_t seq) {
+    for (size_t i = 0; i < n; i++) d[i] = (char) (seq * 31u + (uint32_t) i);
+}
+
+#endif // UDP_BULK_H
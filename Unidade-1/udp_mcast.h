@@ -0,0 +1,77 @@
+// udp_mcast.h - protocolo de fan-out por IP multicast com reparo por NACK (header-only)
+#ifndef UDP_MCAST_H
+#define UDP_MCAST_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/*
+ * FAN-OUT POR MULTICAST (modo mcast)
+ * - O publicador (udp_server <porta> mcast GRUPO PORTA_GRUPO) numera cada mensagem e faz
+ *   um único sendto para o grupo: o custo de envio não depende do número de receptores.
+ * - As últimas MCAST_RING mensagens ficam em um buffer circular para reparo.
+ * - O receptor (multi_client_linux mrecv) detecta buracos na sequência e pede as faixas
+ *   que faltam com NACK (unicast, para a porta do publicador); o publicador reenvia só
+ *   para quem pediu, ou avisa que a mensagem já saiu do buffer (GONE).
+ * - Cada NACK gera no máximo MCAST_MAX_REPAIR reenvios, e cada receptor (e o publicador
+ *   como um todo) tem um orçamento de reparos por segundo: o endereço de origem de um NACK
+ *   não é verificado, então um pedido pequeno não pode virar uma rajada grande para terceiros.
+ *   O que ficar de fora é pedido de novo no próximo NACK.
+ * - Sem tráfego, o publicador envia heartbeats com a última sequência, para que os
+ *   receptores percebam perdas no fim do fluxo.
+ *
+ * Pacotes (campos em big-endian), todos com o cabeçalho mc_hdr_t:
+ *   MC_DATA    publicador -> grupo     seq, payload = mensagem
+ *   MC_HB      publicador -> grupo     seq = última publicada (0 = nenhuma)
+ *   MC_NACK    receptor -> publicador  payload [u32 qtd] qtd x ([u64 início][u32 n])
+ *   MC_REPAIR  publicador -> receptor  igual a MC_DATA, enviado em unicast
+ *   MC_GONE    publicador -> receptor  seq = início, payload [u32 n] (fora do buffer)
+ */
+
+#define MCAST_MAGIC    0xC5
+#define MCAST_MAX      1400     // maior mensagem publicada
+#define MCAST_RING     8192     // mensagens guardadas para reparo
+#define MCAST_MAX_NACK 64       // faixas por NACK
+#define MCAST_MAX_REPAIR 64     // pacotes de reparo (REPAIR ou GONE) por NACK
+
+enum { MC_DATA = 1, MC_HB = 2, MC_NACK = 3, MC_REPAIR = 4, MC_GONE = 5 };
+
+typedef struct {
+    uint8_t magic, type;
+    uint16_t len;     // bytes de payload
+    uint32_t rsv;
+    uint64_t seq;     // big-endian
+} __attribute__((packed)) mc_hdr_t;
+
+static inline void mc_put64(char *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) { p[i] = (char) (v & 0xff); v >>= 8; }
+}
+static inline uint64_t mc_get64(const char *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | (unsigned char) p[i];
+    return v;
+}
+
+static inline uint32_t mc_get32(const char *p) {
+    uint32_t v; memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+static inline void mc_hdr(mc_hdr_t *h, uint8_t type, uint16_t len, uint64_t seq) {
+    h->magic = MCAST_MAGIC; h->type = type; h->len = htons(len); h->rsv = 0;
+    mc_put64((char *) &h->seq, seq);
+}
+
+// Interface de saída/entrada do multicast (MCAST_IF=127.0.0.1 para testar em loopback)
+static inline struct in_addr mc_iface(void) {
+    struct in_addr a = { .s_addr = htonl(INADDR_ANY) };
+    const char *v = getenv("MCAST_IF");
+    if (v) inet_pton(AF_INET, v, &a);
+    return a;
+}
+
+#endif // UDP_MCAST_H
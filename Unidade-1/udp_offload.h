@@ -0,0 +1,202 @@
+// udp_offload.h - eco UDP em lote com UDP_GRO/UDP_SEGMENT e recvmmsg/sendmmsg (header-only)
+#ifndef UDP_OFFLOAD_H
+#define UDP_OFFLOAD_H
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+/*
+ * SEGMENTAÇÃO NO KERNEL (modo offload / cliente flood)
+ * - Recepção: com UDP_GRO, o kernel entrega vários datagramas seguidos do mesmo remetente
+ *   e do mesmo tamanho em um único super-buffer (até 64 KB) e informa o tamanho de cada
+ *   segmento em um cmsg; uoff_rx_seg() devolve esse tamanho e quem lê divide o buffer em
+ *   mensagens lógicas. Sem GRO, cada posição do recvmmsg é um datagrama.
+ * - Envio: uoff_tx_add() junta mensagens consecutivas para o mesmo destino e do mesmo
+ *   tamanho (a última pode ser menor) em um buffer enviado com cmsg UDP_SEGMENT: o kernel
+ *   percorre a pilha uma vez e corta em datagramas no fim. Sem GSO, cada mensagem é uma
+ *   posição do sendmmsg. Nos dois casos, um lote inteiro sai em uma chamada de sistema.
+ * - Recuo automático: GRO e GSO são testados com setsockopt na criação; se o kernel não
+ *   suportar (ou UDP_OFFLOAD=0), o mesmo código segue só com recvmmsg/sendmmsg. Um envio
+ *   segmentado recusado (EINVAL/EIO, p.ex. segmento maior que a MTU) desliga o GSO e todos
+ *   os buffers segmentados que restam no lote saem datagrama por datagrama.
+ * - Um buffer recebido truncado (MSG_TRUNC) é contado em `trunc` e descartado (msg_len = 0).
+ */
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define UOFF_BATCH    64      // buffers por recvmmsg/sendmmsg
+#define UOFF_MAX_SEGS 64      // datagramas por buffer UDP_SEGMENT (limite antigo do kernel)
+#define UOFF_SUPER    65000   // maior buffer de envio (cabe em um datagrama IPv4 de 64 KB)
+#define UOFF_RX_SLOT  65535   // posição de recepção: o maior super-buffer GRO cabe inteiro
+
+typedef struct {
+    int gso;                                        // junta mensagens em buffers UDP_SEGMENT
+    int n;                                          // buffers montados no lote
+    struct mmsghdr msg[UOFF_BATCH];
+    struct iovec iov[UOFF_BATCH];
+    struct sockaddr_in peer[UOFF_BATCH];
+    char ctrl[UOFF_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    uint16_t seg[UOFF_BATCH], nseg[UOFF_BATCH];
+    char closed[UOFF_BATCH];                        // já recebeu o segmento menor (final)
+    char *buf;                                      // UOFF_BATCH x UOFF_SUPER
+    uint64_t pkts, bufs, calls, drops;
+} uoff_tx_t;
+
+typedef struct {
+    int gro;
+    struct mmsghdr msg[UOFF_BATCH];
+    struct iovec iov[UOFF_BATCH];
+    struct sockaddr_in peer[UOFF_BATCH];
+    char ctrl[UOFF_BATCH][CMSG_SPACE(sizeof(int))];
+    char *buf;                                      // UOFF_BATCH x UOFF_RX_SLOT
+    uint64_t pkts, bufs, calls, trunc;
+} uoff_rx_t;
+
+// UDP_OFFLOAD=0 força o caminho só com recvmmsg/sendmmsg (para comparar)
+static inline int uoff_wanted(void) {
+    const char *v = getenv("UDP_OFFLOAD");
+    return !v || atoi(v) != 0;
+}
+
+static uoff_tx_t *uoff_tx_new(int fd, int want) {
+    uoff_tx_t *tx = (uoff_tx_t *) calloc(1, sizeof *tx);
+    if (!tx || !(tx->buf = (char *) malloc((size_t) UOFF_BATCH * UOFF_SUPER))) { free(tx); return NULL; }
+    int zero = 0;  // tamanho 0 = sem segmentação padrão; só testa se a opção existe
+    tx->gso = want && setsockopt(fd, SOL_UDP, UDP_SEGMENT, &zero, sizeof zero) == 0;
+    return tx;
+}
+
+static uoff_rx_t *uoff_rx_new(int fd, int want) {
+    uoff_rx_t *rx = (uoff_rx_t *) calloc(1, sizeof *rx);
+    if (!rx || !(rx->buf = (char *) malloc((size_t) UOFF_BATCH * UOFF_RX_SLOT))) { free(rx); return NULL; }
+    int one = 1;
+    rx->gro = want && setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof one) == 0;
+    return rx;
+}
+
+static void uoff_tx_free(uoff_tx_t *tx) { if (tx) { free(tx->buf); free(tx); } }
+static void uoff_rx_free(uoff_rx_t *rx) { if (rx) { free(rx->buf); free(rx); } }
+
+// Lê até UOFF_BATCH buffers; devolve quantos (ou -1 com errno)
+static int uoff_rx_recv(uoff_rx_t *rx, int fd, int flags) {
+    for (int i = 0; i < UOFF_BATCH; i++) {
+        rx->iov[i] = (struct iovec) { rx->buf + (size_t) i * UOFF_RX_SLOT, UOFF_RX_SLOT };
+        rx->msg[i].msg_hdr = (struct msghdr) {
+            .msg_name = &rx->peer[i], .msg_namelen = sizeof rx->peer[i],
+            .msg_iov = &rx->iov[i], .msg_iovlen = 1,
+            .msg_control = rx->gro ? rx->ctrl[i] : NULL, .msg_controllen = rx->gro ? sizeof rx->ctrl[i] : 0,
+        };
+    }
+    int n = recvmmsg(fd, rx->msg, UOFF_BATCH, flags, NULL);
+    if (n > 0) { rx->bufs += (uint64_t) n; rx->calls++; }
+    for (int i = 0; i < n; i++)
+        if (rx->msg[i].msg_hdr.msg_flags & MSG_TRUNC) { rx->trunc++; rx->msg[i].msg_len = 0; }
+    return n;
+}
+
+// Tamanho de cada mensagem lógica do buffer i (o próprio datagrama, sem GRO)
+static size_t uoff_rx_seg(const uoff_rx_t *rx, int i) {
+    struct msghdr *mh = (struct msghdr *) &rx->msg[i].msg_hdr;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(mh); c; c = CMSG_NXTHDR(mh, c)) {
+        if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+            int g; memcpy(&g, CMSG_DATA(c), sizeof g);
+            if (g > 0) return (size_t) g;
+        }
+    }
+    return rx->msg[i].msg_len ? rx->msg[i].msg_len : 1;
+}
+
+// Envia o buffer i datagrama por datagrama (sem GSO)
+static void uoff_tx_split(uoff_tx_t *tx, int fd, int i) {
+    for (size_t off = 0; off < tx->iov[i].iov_len; off += tx->seg[i]) {
+        size_t m = tx->iov[i].iov_len - off < tx->seg[i] ? tx->iov[i].iov_len - off : tx->seg[i];
+        if (sendto(fd, (char *) tx->iov[i].iov_base + off, m, 0,
+                   (struct sockaddr *) &tx->peer[i], sizeof tx->peer[i]) >= 0) tx->pkts++;
+        else tx->drops++;
+    }
+    tx->bufs++;
+}
+
+// Envia o lote com um sendmmsg (buffers com mais de um segmento levam UDP_SEGMENT)
+static void uoff_tx_flush(uoff_tx_t *tx, int fd) {
+    for (int i = 0; i < tx->n; i++) {
+        struct msghdr *mh = &tx->msg[i].msg_hdr;
+        *mh = (struct msghdr) { .msg_name = &tx->peer[i], .msg_namelen = sizeof tx->peer[i],
+                                .msg_iov = &tx->iov[i], .msg_iovlen = 1 };
+        if (tx->nseg[i] > 1) {
+            mh->msg_control = tx->ctrl[i];
+            mh->msg_controllen = sizeof tx->ctrl[i];
+            struct cmsghdr *c = CMSG_FIRSTHDR(mh);
+            c->cmsg_level = SOL_UDP; c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(c), &tx->seg[i], sizeof(uint16_t));
+        }
+    }
+    for (int done = 0; done < tx->n; ) {
+        // GSO desligado (neste lote ou antes): buffers segmentados saem um datagrama por vez
+        if (!tx->gso && tx->nseg[done] > 1) { uoff_tx_split(tx, fd, done++); continue; }
+        int end = done + 1;
+        while (end < tx->n && (tx->gso || tx->nseg[end] == 1)) end++;
+        int r = sendmmsg(fd, tx->msg + done, (unsigned) (end - done), 0);
+        if (r > 0) {
+            tx->calls++;
+            for (int i = done; i < done + r; i++) { tx->pkts += tx->nseg[i]; tx->bufs++; }
+            done += r;
+            continue;
+        }
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && tx->gso && tx->nseg[done] > 1 && (errno == EINVAL || errno == EIO)) {
+            // Segmentação recusada: desliga o GSO; a próxima volta divide este e os seguintes
+            fprintf(stderr, "[UOFF] UDP_SEGMENT recusado (%s), seguindo sem GSO\n", strerror(errno));
+            tx->gso = 0;
+            continue;
+        }
+        // ENOBUFS e afins: UDP pode perder; descarta o buffer e segue com o resto do lote
+        tx->drops += tx->nseg[done];
+        done++;
+    }
+    tx->n = 0;
+}
+
+// Acrescenta uma mensagem ao lote (junta no buffer anterior quando possível; envia se encher)
+static void uoff_tx_add(uoff_tx_t *tx, int fd, const struct sockaddr_in *peer, const void *data, size_t len) {
+    if (len == 0 || len > UOFF_SUPER) return;
+    int i = tx->n - 1;
+    if (tx->gso && i >= 0 && !tx->closed[i] && len <= tx->seg[i] && tx->nseg[i] < UOFF_MAX_SEGS &&
+        tx->iov[i].iov_len + len <= UOFF_SUPER &&
+        tx->peer[i].sin_addr.s_addr == peer->sin_addr.s_addr && tx->peer[i].sin_port == peer->sin_port) {
+        memcpy((char *) tx->iov[i].iov_base + tx->iov[i].iov_len, data, len);
+        tx->iov[i].iov_len += len;
+        tx->nseg[i]++;
+        tx->closed[i] = len < tx->seg[i];  // segmento menor só pode ser o último
+        return;
+    }
+    if (tx->n == UOFF_BATCH) uoff_tx_flush(tx, fd);
+    i = tx->n++;
+    tx->iov[i] = (struct iovec) { tx->buf + (size_t) i * UOFF_SUPER, len };
+    memcpy(tx->iov[i].iov_base, data, len);
+    tx->peer[i] = *peer;
+    tx->seg[i] = (uint16_t) len; tx->nseg[i] = 1; tx->closed[i] = 0;
+}
+
+// Tempo de CPU do processo (usuário + sistema) em µs
+static inline uint64_t uoff_cpu_us(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t) (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ull +
+           (uint64_t) (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+}
+
+#endif // UDP_OFFLOAD_H
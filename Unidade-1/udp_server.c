@@ -3,6 +3,7 @@
 #include <arpa/inet.h> // Funções de conversão de endereços
 #include <errno.h>
 #include <netinet/in.h> // Definições de estruturas de endereços
+#include <poll.h>
 #include <pthread.h> // Biblioteca para threads POSIX
 #include <signal.h>
 #include <stdio.h>
@@ -12,6 +13,13 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "../comum/alog.h" // Logger assíncrono (ring buffer por thread)
+#include "../comum/trace.h" // Trace de fases por requisição (dump com SIGUSR1)
+#include "../comum/ratelimit.h" // Limite de taxa por IP e teto de requisições em andamento
+#include "udp_bulk.h" // Protocolo do modo bulk (transferência em massa confiável)
+#include "udp_mcast.h" // Protocolo do modo mcast (fan-out por multicast + reparo por NACK)
+#include "udp_offload.h" // Eco em lote com UDP_GRO/UDP_SEGMENT (modo offload)
+
 #define BUFSZ 2048 // Tamanho do buffer para mensagens
 
 /*
@@ -21,12 +29,37 @@
  * - Cada thread simula processamento demorado (sleep) e responde ao cliente com eco e ID da thread.
  * - Permite múltiplos clientes simultâneos, evidenciando concorrência.
  * - Encerramento via Ctrl+C
+ * - Controle de admissão logo após o recvfrom (../comum/ratelimit.h): datagramas acima do
+ *   limite por IP ou com o servidor no teto de requisições recebem "BUSY" (com o
+ *   "[c=...]" da requisição, se houver), sem alocação nem thread.
+ * - Cache de respostas (modo eco): requisições com id "[c=<id>/<tentativa>]" são lembradas
+ *   por (endereço do cliente, id). Uma retransmissão de requisição ainda em processamento
+ *   se junta à original (não cria outra thread); depois de concluída, a resposta guardada é
+ *   reenviada na hora. Despejo por LRU e TTL (UDP_CACHE_N entradas, padrão 4096;
+ *   UDP_CACHE_TTL_S segundos, padrão 30). Acertos/faltas aparecem no encerramento.
+ * - Modo bulk: recebe transferências em massa confiáveis (udp_bulk.h) em uma única
+ *   thread, sem sleep, respondendo com ACK cumulativo + SACK.
+ * - Modo mcast: cada datagrama recebido na porta é publicado uma única vez no grupo
+ *   multicast (udp_mcast.h); NACKs dos receptores são atendidos do buffer de reparo.
+ *   MCAST_GEN=N publica também N mensagens sintéticas por segundo (MCAST_GEN_SIZE bytes).
+ *   Reparos limitados a MCAST_MAX_REPAIR por NACK e MCAST_REPAIR_RATE por segundo por
+ *   receptor (padrão 10000).
+ * - Modo offload: eco puro em uma única thread, sem sleep, em lotes de recvmmsg/sendmmsg.
+ *   Com UDP_GRO, rajadas do mesmo cliente chegam em um super-buffer que é dividido nas
+ *   mensagens originais; os ecos para o mesmo cliente saem juntos em um buffer UDP_SEGMENT
+ *   (udp_offload.h). Sem suporte no kernel, ou com UDP_OFFLOAD=0, fica só o lote. No
+ *   encerramento mostra pacotes/s e CPU por pacote (getrusage).
  *
  * Uso:
- *   ./udp_server <PORTA>
+ *   ./udp_server <PORTA> [eco|bulk|offload]
+ *   ./udp_server <PORTA> mcast <GRUPO> <PORTA_GRUPO>
  *
  * Exemplo:
  *   ./udp_server 6000
+ *   ./udp_server 6000 bulk
+ *   UDP_OFFLOAD=0 ./udp_server 6000 offload
+ *   RL_RATE=20 RL_MAX_INFLIGHT=200 ./udp_server 6000
+ *   MCAST_IF=127.0.0.1 MCAST_GEN=10000 ./udp_server 6000 mcast 239.1.2.3 7000
  */
 
 // Estrutura que armazena dados de uma tarefa para processamento em thread
@@ -36,40 +69,587 @@ typedef struct {
     socklen_t clisz;           // Tamanho da estrutura do cliente
     char *data;                // Dados recebidos
     size_t len;                // Tamanho dos dados
+    trace_t tr;                // Marcas de tempo das fases da requisição
+    struct rc_entry *rc;       // Entrada no cache de respostas (NULL = requisição sem id)
 } task_t;
 
 static volatile int running = 1;  // Variável de controle do loop principal
 
+/* ===========================
+ * Cache de respostas (supressão de duplicatas)
+ * =========================== */
+typedef struct rc_entry {
+    uint32_t ip, id;                        // chave: IP, porta e id de correlação do cliente
+    uint16_t port;
+    int done;                               // 0 = em processamento, 1 = resposta guardada
+    uint32_t joined;                        // retransmissões que se juntaram enquanto pendente
+    char *reply; size_t len;
+    uint64_t done_us;                       // conclusão (referência do TTL)
+    struct rc_entry *hnext;                 // cadeia da tabela hash
+    struct rc_entry *prev, *next;           // lista LRU das concluídas (head = mais recente)
+} rc_entry_t;
+
+static struct {
+    pthread_mutex_t mtx;
+    rc_entry_t **tab; size_t mask;
+    rc_entry_t *head, *tail;                // LRU (só entradas concluídas)
+    size_t n, cap;
+    uint64_t ttl_us;
+    uint64_t hits, joins, misses, evicted, expired;
+} rc = { .mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static void rc_init(void) {
+    const char *v = getenv("UDP_CACHE_N");
+    rc.cap = v ? (size_t) atol(v) : 4096;
+    v = getenv("UDP_CACHE_TTL_S");
+    rc.ttl_us = (uint64_t) ((v ? atof(v) : 30) * 1e6);
+    if (!rc.cap) return;  // UDP_CACHE_N=0 desliga o cache
+    size_t sz = 16;
+    while (sz < 2 * rc.cap) sz <<= 1;
+    rc.tab = (rc_entry_t **) calloc(sz, sizeof *rc.tab);
+    rc.mask = rc.tab ? sz - 1 : 0;
+}
+
+// Extrai o id de "[c=<id>/<tentativa>]" do início da mensagem
+static int rc_req_id(const char *buf, size_t n, uint32_t *id) {
+    char tmp[24];
+    if (n < 5 || memcmp(buf, "[c=", 3) != 0) return 0;
+    size_t m = n < sizeof tmp - 1 ? n : sizeof tmp - 1;
+    memcpy(tmp, buf, m); tmp[m] = '\0';
+    unsigned x;
+    if (sscanf(tmp, "[c=%x/", &x) != 1) return 0;
+    *id = x;
+    return 1;
+}
+
+static rc_entry_t **rc_slot(const struct sockaddr_in *cli, uint32_t id) {
+    uint64_t h = ((uint64_t) cli->sin_addr.s_addr << 16 ^ cli->sin_port ^ (uint64_t) id << 32) * 0x9E3779B97F4A7C15ull;
+    rc_entry_t **pp = &rc.tab[(h >> 32) & rc.mask];
+    while (*pp && ((*pp)->ip != cli->sin_addr.s_addr || (*pp)->port != cli->sin_port || (*pp)->id != id))
+        pp = &(*pp)->hnext;
+    return pp;
+}
+
+static void rc_lru_unlink(rc_entry_t *e) {
+    if (e->prev) e->prev->next = e->next; else rc.head = e->next;
+    if (e->next) e->next->prev = e->prev; else rc.tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void rc_lru_push(rc_entry_t *e) {
+    e->prev = NULL; e->next = rc.head;
+    if (rc.head) rc.head->prev = e; else rc.tail = e;
+    rc.head = e;
+}
+
+// Remove uma entrada concluída (tabela + LRU) e libera a memória
+static void rc_drop(rc_entry_t *e) {
+    struct sockaddr_in a = { .sin_port = e->port, .sin_addr.s_addr = e->ip };
+    rc_entry_t **pp = rc_slot(&a, e->id);
+    *pp = e->hnext;
+    rc_lru_unlink(e);
+    free(e->reply); free(e);
+    rc.n--;
+}
+
+/*
+ * Consulta o cache antes da admissão (chamada só pela thread principal).
+ * Retorna 1 se a requisição já foi tratada: resposta reenviada ou retransmissão juntada à
+ * original em processamento; 0 se é nova (ou a entrada expirou).
+ */
+static int rc_lookup(int sfd, const struct sockaddr_in *cli, socklen_t cl, uint32_t id) {
+    char out[BUFSZ]; size_t len = 0;
+    pthread_mutex_lock(&rc.mtx);
+    rc_entry_t *e = *rc_slot(cli, id);
+    if (e && e->done && bulk_now_us() - e->done_us > rc.ttl_us) { rc_drop(e); e = NULL; rc.expired++; }
+    if (!e) { rc.misses++; pthread_mutex_unlock(&rc.mtx); return 0; }
+    if (e->done) {
+        rc.hits++;
+        rc_lru_unlink(e); rc_lru_push(e);
+        len = e->len < sizeof out ? e->len : sizeof out;
+        memcpy(out, e->reply, len);
+    } else {
+        rc.joins++; e->joined++;
+    }
+    pthread_mutex_unlock(&rc.mtx);
+    if (len) {
+        sendto(sfd, out, len, MSG_DONTWAIT, (const struct sockaddr *) cli, cl);
+        alog_peer(ALOG_DEBUG, "[UDP] retransmissão de %s:%d respondida do cache\n", cli);
+    } else {
+        alog_peer(ALOG_DEBUG, "[UDP] retransmissão de %s:%d aguardando a original\n", cli);
+    }
+    return 1;
+}
+
+// Registra a requisição como em processamento; NULL se o cache está cheio de pendentes
+static rc_entry_t *rc_insert(const struct sockaddr_in *cli, uint32_t id) {
+    pthread_mutex_lock(&rc.mtx);
+    uint64_t now = bulk_now_us();
+    // Libera espaço: primeiro as expiradas, depois a concluída usada há mais tempo
+    while (rc.tail && (rc.n >= rc.cap || now - rc.tail->done_us > rc.ttl_us)) {
+        if (now - rc.tail->done_us > rc.ttl_us) rc.expired++; else rc.evicted++;
+        rc_drop(rc.tail);
+    }
+    rc_entry_t *e = NULL;
+    if (rc.n < rc.cap && (e = (rc_entry_t *) calloc(1, sizeof *e))) {
+        e->ip = cli->sin_addr.s_addr; e->port = cli->sin_port; e->id = id;
+        rc_entry_t **pp = rc_slot(cli, id);
+        e->hnext = *pp; *pp = e;
+        rc.n++;
+    }
+    pthread_mutex_unlock(&rc.mtx);
+    return e;
+}
+
+// Guarda a resposta de uma requisição concluída (pendentes nunca são despejadas)
+static void rc_complete(rc_entry_t *e, const char *out, size_t len) {
+    char *copy = (char *) malloc(len);
+    pthread_mutex_lock(&rc.mtx);
+    if (copy) memcpy(copy, out, len);
+    e->reply = copy; e->len = copy ? len : 0;
+    e->done = 1; e->done_us = bulk_now_us();
+    rc_lru_push(e);
+    if (e->joined)
+        alog_num(ALOG_DEBUG, "[UDP] %llu retransmissões atendidas pela mesma execução\n", e->joined);
+    pthread_mutex_unlock(&rc.mtx);
+}
+
+static void rc_report(void) {
+    fprintf(stderr, "[UDP] cache de respostas: %llu acertos, %llu juntadas a pendentes, %llu faltas, "
+        "%llu despejadas (LRU), %llu expiradas (TTL), %zu entradas\n",
+        (unsigned long long) rc.hits, (unsigned long long) rc.joins, (unsigned long long) rc.misses,
+        (unsigned long long) rc.evicted, (unsigned long long) rc.expired, rc.n);
+}
+
 // Função executada por cada thread para processar requisições
 static void *worker(void *p) {
     task_t *t = (task_t *) p;
-    char ip[INET_ADDRSTRLEN];
-    
-    // Converte IP do cliente para string legível
-    inet_ntop(AF_INET, &t->cli.sin_addr, ip, sizeof ip);
-    int cport = ntohs(t->cli.sin_port);  // Extrai a porta do cliente com ntohs()
+    trace_mark(&t->tr, "dispatch");  // Espera até a thread começar a rodar
 
-    fprintf(stderr, "[UDP] de %s:%d: %.*s\n", ip, cport, (int) t->len, t->data);
-    fprintf(stderr, "[UDP] processando %s:%d...\n", ip, cport);
+    // Registra em binário; a formatação do endereço acontece na thread do logger
+    alog_peer_str(ALOG_INFO, "[UDP] de %s:%d: %.*s\n", &t->cli, t->data, t->len);
+    alog_peer(ALOG_INFO, "[UDP] processando %s:%d...\n", &t->cli);
     
     sleep(5);  // Simula processamento demorado
+    trace_mark(&t->tr, "process");
 
     // Prepara resposta incluindo ID da thread
     char out[BUFSZ];
     int n = snprintf(out, sizeof out, "OK UDP thr=%lu eco: %.*s",
         (unsigned long) pthread_self(), (int) t->len, t->data);
+    if (n < 0) n = 0;
+    if ((size_t) n >= sizeof out) n = (int) sizeof out - 1;  // snprintf devolve o tamanho sem corte
 
     // Envia resposta de volta para o cliente
     sendto(t->sfd, out, n, 0, (struct sockaddr *) &t->cli, t->clisz); 
+    if (t->rc) rc_complete(t->rc, out, (size_t) n);  // Retransmissões futuras recebem esta resposta
+    trace_mark(&t->tr, "send");
+    trace_commit(&t->tr);  // Guarda no flight recorder
     
     // UDP não fecha conexão, é stateless
 
     // Libera memória alocada
     free(t->data);
     free(t);
+    rl_done();  // Libera a vaga no teto de requisições em andamento
+    return NULL;
+}
+
+// Recusa barata: "BUSY" + o id de correlação "[c=...]" do cliente, sem bloquear
+static void reject_busy(int sfd, const char *buf, size_t n, const struct sockaddr_in *cli, socklen_t cl) {
+    char out[64] = "BUSY";
+    size_t m = 4;
+    const char *end = n > 3 && memcmp(buf, "[c=", 3) == 0 ? memchr(buf, ']', n < 40 ? n : 40) : NULL;
+    if (end) {
+        out[m++] = ' ';
+        memcpy(out + m, buf, (size_t) (end - buf) + 1);
+        m += (size_t) (end - buf) + 1;
+    }
+    sendto(sfd, out, m, MSG_DONTWAIT, (const struct sockaddr *) cli, cl);
+}
+
+/* ===========================
+ * Modo bulk (receptor)
+ * =========================== */
+#define BULK_MAX_XFERS 16  // transferências simultâneas
+#define BULK_IDLE_US   10000000ull  // descarta transferência parada há 10 s
+
+typedef struct {
+    int used, done;
+    struct sockaddr_in cli;
+    uint32_t xfer, mss, npk;
+    uint64_t total;
+    uint8_t *bits;             // pacotes recebidos
+    uint32_t cum, max_seen;    // cum = primeiro pacote ainda não recebido
+    uint32_t got, dups, unacked, ts_echo;
+    uint64_t bytes, sum, t0, last;
+} bulk_rx_t;
+
+static bulk_rx_t bulk_rx[BULK_MAX_XFERS];
+static uint64_t bulk_max_total;  // bytes (BULK_MAX_MB)
+
+static int bit_get(const uint8_t *b, uint32_t i) { return b[i >> 3] >> (i & 7) & 1; }
+
+static bulk_rx_t *bulk_find(const struct sockaddr_in *cli, uint32_t xfer) {
+    for (int i = 0; i < BULK_MAX_XFERS; i++) {
+        bulk_rx_t *x = &bulk_rx[i];
+        if (x->used && x->xfer == xfer && x->cli.sin_addr.s_addr == cli->sin_addr.s_addr &&
+            x->cli.sin_port == cli->sin_port) return x;
+    }
     return NULL;
 }
 
+// ACK cumulativo + blocos SACK das faixas recebidas acima de cum
+static void bulk_send_ack(int sfd, bulk_rx_t *x) {
+    char out[sizeof(bulk_hdr_t) + 4 + BULK_MAX_SACK * 8];
+    char *p = out + sizeof(bulk_hdr_t) + 4;
+    uint32_t nb = 0;
+    for (uint32_t i = x->cum; i <= x->max_seen && i < x->npk && nb < BULK_MAX_SACK;) {
+        if (!bit_get(x->bits, i)) { i++; continue; }
+        uint32_t start = i;
+        while (i < x->npk && bit_get(x->bits, i)) i++;
+        uint32_t be[2] = { htonl(start), htonl(i) };
+        memcpy(p, be, 8); p += 8; nb++;
+    }
+    bulk_hdr_t *h = (bulk_hdr_t *) out;
+    *h = (bulk_hdr_t) { BULK_MAGIC, BULK_ACK, htons((uint16_t) (4 + nb * 8)), htonl(x->xfer), htonl(x->cum), htonl(x->ts_echo) };
+    uint32_t nbe = htonl(nb); memcpy(out + sizeof *h, &nbe, 4);
+    sendto(sfd, out, (size_t) (p - out), 0, (struct sockaddr *) &x->cli, sizeof x->cli);
+    x->unacked = 0;
+}
+
+static void bulk_send_done(int sfd, bulk_rx_t *x) {
+    char out[sizeof(bulk_hdr_t) + 16];
+    bulk_hdr_t *h = (bulk_hdr_t *) out;
+    *h = (bulk_hdr_t) { BULK_MAGIC, BULK_DONE, htons(16), htonl(x->xfer), htonl(x->npk), 0 };
+    bulk_put64(out + sizeof *h, x->bytes); bulk_put64(out + sizeof *h + 8, x->sum);
+    sendto(sfd, out, sizeof out, 0, (struct sockaddr *) &x->cli, sizeof x->cli);
+}
+
+static void bulk_on_packet(int sfd, const char *buf, size_t n, const struct sockaddr_in *cli) {
+    if (n < sizeof(bulk_hdr_t)) return;
+    bulk_hdr_t h; memcpy(&h, buf, sizeof h);
+    if (h.magic != BULK_MAGIC) return;
+    const char *pl = buf + sizeof h;
+    size_t plen = n - sizeof h;
+    uint32_t xfer = ntohl(h.xfer), seq = ntohl(h.seq);
+    bulk_rx_t *x = bulk_find(cli, xfer);
+    uint64_t now = bulk_now_us();
+
+    if (h.type == BULK_START) {
+        if (!x) {
+            // Tamanho vem do cliente: limita antes de alocar o bitmap
+            uint64_t total = plen >= 8 ? bulk_get64(pl) : 0;
+            if (!seq || seq > BULK_MAX_MSS || !total) return;
+            if (total > bulk_max_total) {
+                alog_peer(ALOG_WARN, "[UDP] bulk: transferência de %s:%d maior que BULK_MAX_MB, recusada\n", cli);
+                return;
+            }
+            uint64_t npk = (total + seq - 1) / seq;
+            if (npk > UINT32_MAX) return;
+            for (int i = 0; i < BULK_MAX_XFERS && !x; i++) if (!bulk_rx[i].used) x = &bulk_rx[i];
+            if (!x) { alog_peer(ALOG_WARN, "[UDP] bulk: sem vaga para %s:%d\n", cli); return; }
+            uint8_t *bits = (uint8_t *) calloc((size_t) ((npk + 7) / 8), 1);
+            if (!bits) { alog_peer(ALOG_WARN, "[UDP] bulk: sem memória para %s:%d\n", cli); return; }
+            *x = (bulk_rx_t) { .used = 1, .cli = *cli, .xfer = xfer, .mss = seq, .npk = (uint32_t) npk, .total = total,
+                               .bits = bits, .t0 = now };
+            alog_peer(ALOG_INFO, "[UDP] bulk: transferência de %s:%d iniciada\n", cli);
+            alog_num(ALOG_INFO, "[UDP] bulk: tamanho %llu bytes\n", total);
+        }
+        x->last = now;
+        if (x->done) bulk_send_done(sfd, x); else bulk_send_ack(sfd, x);
+        return;
+    }
+    if (h.type != BULK_DATA || !x) return;
+    x->last = now;
+    if (x->done) { bulk_send_done(sfd, x); return; }
+    if (seq >= x->npk) return;
+    x->ts_echo = ntohl(h.ts);
+
+    if (bit_get(x->bits, seq)) { x->dups++; bulk_send_ack(sfd, x); return; }  // retransmissão desnecessária
+    x->bits[seq >> 3] |= (uint8_t) (1u << (seq & 7));
+    x->got++; x->bytes += plen;
+    x->sum += bulk_hash(seq, pl, plen);
+    if (seq > x->max_seen) x->max_seen = seq;
+    uint32_t old = x->cum;
+    while (x->cum < x->npk && bit_get(x->bits, x->cum)) x->cum++;
+
+    if (x->got == x->npk) {
+        x->done = 1;
+        double secs = (now - x->t0) / 1e6;
+        bulk_send_done(sfd, x);
+        alog_peer(ALOG_INFO, "[UDP] bulk: transferência de %s:%d concluída\n", &x->cli);
+        alog_num(ALOG_INFO, "[UDP] bulk: %llu bytes recebidos\n", x->bytes);
+        alog_num(ALOG_INFO, "[UDP] bulk: %llu kbit/s\n", (uint64_t) (secs > 0 ? x->bytes * 8 / secs / 1000 : 0));
+        alog_num(ALOG_INFO, "[UDP] bulk: %llu pacotes duplicados\n", x->dups);
+        return;
+    }
+    // Fora de ordem ou buraco preenchido: ACK imediato; em ordem: um ACK a cada 2 pacotes
+    if (seq != old || x->cum != old + 1 || ++x->unacked >= 2) bulk_send_ack(sfd, x);
+}
+
+static void bulk_serve(int sfd) {
+    int sz = 8 << 20;
+    setsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    setsockopt(sfd, SOL_SOCKET, SO_SNDBUF, &sz, sizeof sz);
+    const char *v = getenv("BULK_MAX_MB");
+    bulk_max_total = (uint64_t) (v ? atoll(v) : BULK_MAX_MB) << 20;
+    fprintf(stderr, "[UDP] modo bulk (até %llu MB por transferência)\n", (unsigned long long) (bulk_max_total >> 20));
+
+    char buf[sizeof(bulk_hdr_t) + BULK_MAX_MSS];
+    while (running) {
+        // Com ACK atrasado pendente, espera no máximo 1 ms antes de enviá-lo
+        int pending = 0;
+        for (int i = 0; i < BULK_MAX_XFERS; i++) pending |= bulk_rx[i].used && bulk_rx[i].unacked;
+        struct pollfd pfd = { .fd = sfd, .events = POLLIN };
+        int r = poll(&pfd, 1, pending ? 1 : 1000);
+        if (r < 0 && errno != EINTR) { perror("poll"); break; }
+
+        // Drena o socket sem bloquear
+        for (int k = 0; r > 0 && k < 256; k++) {
+            struct sockaddr_in cli; socklen_t cl = sizeof cli;
+            ssize_t n = recvfrom(sfd, buf, sizeof buf, MSG_DONTWAIT, (struct sockaddr *) &cli, &cl);
+            if (n < 0) break;
+            bulk_on_packet(sfd, buf, (size_t) n, &cli);
+        }
+
+        uint64_t now = bulk_now_us();
+        for (int i = 0; i < BULK_MAX_XFERS; i++) {
+            bulk_rx_t *x = &bulk_rx[i];
+            if (!x->used) continue;
+            if (x->unacked && r == 0) bulk_send_ack(sfd, x);
+            if (now - x->last > BULK_IDLE_US) {
+                if (!x->done) alog_peer(ALOG_WARN, "[UDP] bulk: transferência de %s:%d abandonada\n", &x->cli);
+                free(x->bits);
+                x->used = 0;
+            }
+        }
+    }
+}
+
+/* ===========================
+ * Modo mcast (publicador)
+ * =========================== */
+#define MCAST_HB_US 100000  // heartbeat após 100 ms sem publicar
+#define MCAST_PEERS 1024    // orçamentos de reparo por receptor (tabela de acesso direto)
+
+typedef struct { uint64_t seq; uint16_t len; char data[MCAST_MAX]; } mc_slot_t;
+
+// Orçamento de reparos (token bucket, em pacotes)
+typedef struct { uint32_t ip; uint16_t port; double tokens; uint64_t last_us; } mc_budget_t;
+
+static struct {
+    int sfd;
+    struct sockaddr_in group;
+    mc_slot_t *ring;
+    uint64_t last;                                  // última sequência publicada
+    uint64_t published, repaired, gone, nacks, throttled;
+    double repair_rate, repair_burst;               // por receptor; o total é MCAST_PEERS_ALL x
+    mc_budget_t *peers, all;
+} mc;
+
+#define MCAST_PEERS_ALL 8   // orçamento total = 8 receptores no ritmo máximo
+
+// Retira até want fichas do bucket (recarga preguiçosa); devolve quantas conseguiu
+static uint32_t mc_budget_take(mc_budget_t *b, double rate, double burst, uint32_t want, uint64_t now) {
+    b->tokens += (double) (now - b->last_us) * rate / 1e6;
+    if (b->tokens > burst) b->tokens = burst;
+    b->last_us = now;
+    uint32_t n = b->tokens < want ? (uint32_t) b->tokens : want;
+    b->tokens -= n;
+    return n;
+}
+
+// Quantos reparos este NACK pode gerar: limite por NACK, por receptor e total (*peer = bucket do receptor)
+static uint32_t mc_repair_budget(const struct sockaddr_in *cli, uint64_t now, mc_budget_t **peer) {
+    uint32_t h = (uint32_t) ((cli->sin_addr.s_addr ^ (uint32_t) cli->sin_port << 16) * 2654435761u) >> 22;
+    mc_budget_t *b = &mc.peers[h % MCAST_PEERS];
+    if (b->ip != cli->sin_addr.s_addr || b->port != cli->sin_port)  // receptor novo ocupa a posição
+        *b = (mc_budget_t) { cli->sin_addr.s_addr, cli->sin_port, mc.repair_burst, now };
+    uint32_t n = mc_budget_take(b, mc.repair_rate, mc.repair_burst, MCAST_MAX_REPAIR, now);
+    uint32_t m = mc_budget_take(&mc.all, mc.repair_rate * MCAST_PEERS_ALL, mc.repair_burst * MCAST_PEERS_ALL, n, now);
+    b->tokens += n - m;  // devolve o que o orçamento total não cobriu
+    *peer = b;
+    return m;
+}
+
+static void mc_publish(const char *d, size_t n) {
+    if (n > MCAST_MAX) n = MCAST_MAX;
+    mc_slot_t *sl = &mc.ring[++mc.last % MCAST_RING];
+    sl->seq = mc.last; sl->len = (uint16_t) n;
+    memcpy(sl->data, d, n);
+    char pkt[sizeof(mc_hdr_t) + MCAST_MAX];
+    mc_hdr((mc_hdr_t *) pkt, MC_DATA, (uint16_t) n, mc.last);
+    memcpy(pkt + sizeof(mc_hdr_t), d, n);
+    sendto(mc.sfd, pkt, sizeof(mc_hdr_t) + n, 0, (struct sockaddr *) &mc.group, sizeof mc.group);  // um envio para todos
+    mc.published++;
+}
+
+// Reenvia (unicast) as faixas pedidas que ainda estão no buffer; avisa as que já saíram.
+// Cada pacote enviado (REPAIR ou GONE) gasta uma ficha do orçamento; o resto fica para o próximo NACK.
+static void mc_on_nack(const char *pl, size_t plen, const struct sockaddr_in *cli) {
+    mc.nacks++;
+    uint32_t cnt = plen >= 4 ? mc_get32(pl) : 0;
+    mc_budget_t *peer;
+    uint32_t budget = mc_repair_budget(cli, bulk_now_us(), &peer);
+    char pkt[sizeof(mc_hdr_t) + MCAST_MAX];
+    for (uint32_t k = 0; k < cnt && k < MCAST_MAX_NACK && 4 + (k + 1) * 12 <= plen; k++) {
+        uint64_t from = mc_get64(pl + 4 + k * 12);
+        uint32_t n = mc_get32(pl + 4 + k * 12 + 8);
+        if (from == 0 || from > mc.last) continue;
+        if (n > MCAST_RING) n = MCAST_RING;
+        if (from + n > mc.last + 1) n = (uint32_t) (mc.last + 1 - from);
+        uint64_t oldest = mc.last >= MCAST_RING ? mc.last - MCAST_RING + 1 : 1;
+        if (from < oldest && budget) {
+            uint32_t g = (uint32_t) (oldest - from < n ? oldest - from : n);
+            mc_hdr((mc_hdr_t *) pkt, MC_GONE, 4, from);
+            uint32_t gbe = htonl(g); memcpy(pkt + sizeof(mc_hdr_t), &gbe, 4);
+            sendto(mc.sfd, pkt, sizeof(mc_hdr_t) + 4, 0, (const struct sockaddr *) cli, sizeof *cli);
+            mc.gone += g; from += g; n -= g; budget--;
+        }
+        uint32_t r = n < budget ? n : budget;
+        mc.throttled += n - r;
+        for (uint64_t q = from; q < from + r; q++) {
+            mc_slot_t *sl = &mc.ring[q % MCAST_RING];
+            mc_hdr((mc_hdr_t *) pkt, MC_REPAIR, sl->len, q);
+            memcpy(pkt + sizeof(mc_hdr_t), sl->data, sl->len);
+            sendto(mc.sfd, pkt, sizeof(mc_hdr_t) + sl->len, 0, (const struct sockaddr *) cli, sizeof *cli);
+            mc.repaired++;
+        }
+        budget -= r;
+    }
+    peer->tokens += budget; mc.all.tokens += budget;  // devolve o que este NACK não usou
+}
+
+static void mcast_serve(int sfd, const char *group, int gport) {
+    mc.sfd = sfd;
+    mc.group.sin_family = AF_INET;
+    mc.group.sin_port = htons(gport);
+    if (inet_pton(AF_INET, group, &mc.group.sin_addr) != 1) { fprintf(stderr, "[UDP] grupo inválido: %s\n", group); return; }
+    mc.ring = (mc_slot_t *) calloc(MCAST_RING, sizeof *mc.ring);
+    mc.peers = (mc_budget_t *) calloc(MCAST_PEERS, sizeof *mc.peers);
+    if (!mc.ring || !mc.peers) { perror("[UDP] mcast"); free(mc.ring); free(mc.peers); return; }
+    const char *rr = getenv("MCAST_REPAIR_RATE");
+    mc.repair_rate = rr ? atof(rr) : 10000;  // reparos por segundo por receptor
+    mc.repair_burst = mc.repair_rate / 10 > MCAST_MAX_REPAIR ? mc.repair_rate / 10 : MCAST_MAX_REPAIR;
+    mc.all = (mc_budget_t) { 0, 0, mc.repair_burst * MCAST_PEERS_ALL, bulk_now_us() };
+    struct in_addr ifa = mc_iface();
+    unsigned char ttl = 1, loop = 1;
+    setsockopt(sfd, IPPROTO_IP, IP_MULTICAST_IF, &ifa, sizeof ifa);
+    setsockopt(sfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof ttl);
+    setsockopt(sfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof loop);  // receptores na mesma máquina
+    int sz = 4 << 20;
+    setsockopt(sfd, SOL_SOCKET, SO_SNDBUF, &sz, sizeof sz);
+
+    const char *v = getenv("MCAST_GEN");
+    double gen_rate = v ? atof(v) : 0;
+    v = getenv("MCAST_GEN_SIZE");
+    size_t gen_size = v ? (size_t) atoi(v) : 100;
+    if (gen_size < 24) gen_size = 24;
+    if (gen_size > MCAST_MAX) gen_size = MCAST_MAX;
+    fprintf(stderr, "[UDP] modo mcast: grupo %s:%d (%.0f msgs/s sintéticas)\n", group, gport, gen_rate);
+
+    char buf[BUFSZ], gen[MCAST_MAX];
+    memset(gen, '.', sizeof gen);
+    uint64_t t0 = bulk_now_us(), last_send = t0, generated = 0;
+    while (running) {
+        struct pollfd pfd = { .fd = sfd, .events = POLLIN };
+        int r = poll(&pfd, 1, gen_rate > 0 ? 1 : 50);
+        if (r < 0 && errno != EINTR) { perror("poll"); break; }
+
+        for (int k = 0; r > 0 && k < 256; k++) {
+            struct sockaddr_in cli; socklen_t cl = sizeof cli;
+            ssize_t n = recvfrom(sfd, buf, sizeof buf, MSG_DONTWAIT, (struct sockaddr *) &cli, &cl);
+            if (n < 0) break;
+            mc_hdr_t h; memcpy(&h, buf, sizeof h < (size_t) n ? sizeof h : (size_t) n);
+            if ((size_t) n >= sizeof h && h.magic == MCAST_MAGIC && h.type == MC_NACK) {
+                mc_on_nack(buf + sizeof h, (size_t) n - sizeof h, &cli);
+                continue;
+            }
+            // Qualquer outro datagrama é uma mensagem a publicar; o produtor recebe a sequência
+            mc_publish(buf, (size_t) n);
+            last_send = bulk_now_us();
+            char out[64];
+            int m = snprintf(out, sizeof out, "OK MCAST seq=%llu", (unsigned long long) mc.last);
+            sendto(sfd, out, (size_t) m, 0, (struct sockaddr *) &cli, cl);
+        }
+
+        uint64_t now = bulk_now_us();
+        if (gen_rate > 0) {  // fluxo sintético no ritmo pedido
+            uint64_t due = (uint64_t) ((now - t0) / 1e6 * gen_rate);
+            for (; generated < due; generated++) {
+                int m = snprintf(gen, sizeof gen, "GEN %llu ", (unsigned long long) mc.last + 1);
+                gen[m] = '.';
+                mc_publish(gen, gen_size);
+            }
+            last_send = now;
+        }
+        if (now - last_send >= MCAST_HB_US) {
+            char pkt[sizeof(mc_hdr_t)];
+            mc_hdr((mc_hdr_t *) pkt, MC_HB, 0, mc.last);
+            sendto(sfd, pkt, sizeof pkt, 0, (struct sockaddr *) &mc.group, sizeof mc.group);
+            last_send = now;
+        }
+    }
+    fprintf(stderr, "[UDP] mcast: %llu publicadas, %llu reparos, %llu fora do buffer, %llu NACKs, "
+        "%llu reparos adiados pelo orçamento\n",
+        (unsigned long long) mc.published, (unsigned long long) mc.repaired, (unsigned long long) mc.gone,
+        (unsigned long long) mc.nacks, (unsigned long long) mc.throttled);
+    free(mc.ring); free(mc.peers);
+}
+
+/* ===========================
+ * Modo offload (eco em lote com GRO/GSO)
+ * =========================== */
+static void offload_serve(int sfd) {
+    int sz = 8 << 20;
+    setsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &sz, sizeof sz);
+    setsockopt(sfd, SOL_SOCKET, SO_SNDBUF, &sz, sizeof sz);
+    int want = uoff_wanted();
+    uoff_rx_t *rx = uoff_rx_new(sfd, want);
+    uoff_tx_t *tx = uoff_tx_new(sfd, want);
+    if (!rx || !tx) { perror("[UDP] offload"); uoff_rx_free(rx); uoff_tx_free(tx); return; }
+    fprintf(stderr, "[UDP] modo offload: GRO %s, GSO %s\n", rx->gro ? "ligado" : "desligado",
+        tx->gso ? "ligado" : "desligado");
+
+    uint64_t cpu0 = uoff_cpu_us(), t_first = 0, t_last = 0;
+    while (running) {
+        struct pollfd pfd = { .fd = sfd, .events = POLLIN };
+        int r = poll(&pfd, 1, 1000);
+        if (r < 0 && errno != EINTR) { perror("poll"); break; }
+
+        // Drena o socket: cada recvmmsg traz até UOFF_BATCH buffers; os ecos saem em um sendmmsg
+        for (int k = 0; r > 0 && k < 64; k++) {
+            int n = uoff_rx_recv(rx, sfd, MSG_DONTWAIT);
+            if (n <= 0) break;
+            for (int i = 0; i < n; i++) {
+                size_t len = rx->msg[i].msg_len, seg = uoff_rx_seg(rx, i);
+                const char *b = (const char *) rx->iov[i].iov_base;
+                for (size_t off = 0; off < len; off += seg) {  // super-buffer -> mensagens lógicas
+                    size_t m = len - off < seg ? len - off : seg;
+                    rx->pkts++;
+                    uoff_tx_add(tx, sfd, &rx->peer[i], b + off, m);
+                }
+            }
+            uoff_tx_flush(tx, sfd);
+            t_last = bulk_now_us();
+            if (!t_first) t_first = t_last;
+        }
+    }
+
+    // CPU por pacote conta o processo inteiro; sem tráfego o poll não gasta CPU
+    double secs = (t_last - t_first) / 1e6, cpu = (double) (uoff_cpu_us() - cpu0);
+    fprintf(stderr, "[UDP] offload: %llu pacotes recebidos em %llu buffers (%llu recvmmsg), "
+        "%llu ecos em %llu buffers (%llu sendmmsg), %llu descartados, %llu buffers truncados\n",
+        (unsigned long long) rx->pkts, (unsigned long long) rx->bufs, (unsigned long long) rx->calls,
+        (unsigned long long) tx->pkts, (unsigned long long) tx->bufs, (unsigned long long) tx->calls,
+        (unsigned long long) tx->drops, (unsigned long long) rx->trunc);
+    if (rx->pkts)
+        fprintf(stderr, "[UDP] offload: %.0f pacotes/s, %.0f ns de CPU por pacote (eco incluído)\n",
+            secs > 0 ? rx->pkts / secs : 0.0, cpu * 1000 / rx->pkts);
+    uoff_rx_free(rx); uoff_tx_free(tx);
+}
+
 // Handler para sinal SIGINT (Ctrl+C)
 static void on_sig(int s) {
     (void)s;
@@ -78,12 +658,15 @@ static void on_sig(int s) {
 }
 
 int main(int argc, char **argv) {
-    if (argc != 2) { 
-        fprintf(stderr, "uso: %s <porta>\n", argv[0]); 
+    int mcast = argc == 5 && strcmp(argv[2], "mcast") == 0;
+    if ((argc < 2 || argc > 3) && !mcast) { 
+        fprintf(stderr, "uso: %s <porta> [eco|bulk|offload]\n       %s <porta> mcast <grupo> <porta_grupo>\n", argv[0], argv[0]); 
         return 1; 
     }
 
     int port = atoi(argv[1]);
+    int bulk = argc == 3 && strcmp(argv[2], "bulk") == 0;
+    int offload = argc == 3 && strcmp(argv[2], "offload") == 0;
 
     struct sigaction sa;
     sa.sa_handler = on_sig;
@@ -118,9 +701,19 @@ int main(int argc, char **argv) {
     }
 
     fprintf(stderr, "[UDP] escutando 0.0.0.0:%d\n", port);
+    if (trace_init("udp") < 0 || alog_init() < 0 || rl_init() < 0) {
+        fprintf(stderr, "[UDP] falha ao iniciar logger/trace/limitador\n");
+        return 1;
+    }
 
-    // Loop principal do servidor
-    while (running) {
+    int eco = !bulk && !mcast && !offload;
+    if (eco) rc_init();
+    if (bulk) bulk_serve(sfd);
+    if (mcast) mcast_serve(sfd, argv[3], atoi(argv[4]));
+    if (offload) offload_serve(sfd);
+
+    // Loop principal do servidor (modo eco)
+    while (running && eco) {
         char buf[BUFSZ]; 
         struct sockaddr_in cli; 
         socklen_t cl = sizeof cli;
@@ -133,14 +726,27 @@ int main(int argc, char **argv) {
             perror("recvfrom"); continue; 
         }
 
+        // Retransmissão já vista: reenvia a resposta guardada ou espera a original, sem nova thread
+        uint32_t rid;
+        int has_id = rc.tab && rc_req_id(buf, (size_t) n, &rid);
+        if (has_id && rc_lookup(sfd, &cli, cl, rid)) continue;
+
+        // Admissão antes de qualquer alocação: recusa barata, sem thread
+        if (rl_admit(&cli) != RL_OK) {
+            reject_busy(sfd, buf, (size_t) n, &cli, cl);
+            continue;
+        }
+
         // Cria estrutura de tarefa para a thread
         task_t *t = malloc(sizeof * t); 
+        trace_begin(&t->tr, &cli);  // t0 = chegada do datagrama (retorno do recvfrom)
         t->sfd = sfd; t->cli = cli; 
         t->clisz = cl;
         t->data = malloc(n);  // Aloca memória para os dados
         
         memcpy(t->data, buf, n);  // Copia dados recebidos
         t->len = (size_t) n;
+        t->rc = has_id ? rc_insert(&cli, rid) : NULL;
         
         // Cria nova thread para processar a requisição
         pthread_t th; 
@@ -149,6 +755,8 @@ int main(int argc, char **argv) {
     }
 
     close(sfd); 
+    alog_shutdown();  // Drena os registros pendentes antes de sair
+    if (eco) { rl_report("[UDP]"); rc_report(); }
     fprintf(stderr, "[UDP] encerrado\n"); 
     return 0;
 }
@@ -0,0 +1,53 @@
+import { Publisher, BatchSettings } from './index';
+
+/*
+ Benchmark do Publisher: mede a vazão (msgs/s) para diferentes configurações de lote.
+ Use com o broker local (MENSAGERIA_BACKEND=local) para medir sem a latência da nuvem.
+
+ Uso:
+   npm run bench:publisher -- [N_MENSAGENS]
+*/
+const total = Number(process.argv[2] || process.env.BENCH_MESSAGES || 50000);
+const topic = process.env.TOPIC_NAME || 'sistemas-distribuidos';
+
+// A primeira linha reproduz o publishBatch antigo: uma ida e volta por mensagem
+const configs: Array<Partial<BatchSettings>> = [
+    { maxMessages: 1, maxInFlightBatches: 1 },
+    { maxMessages: 10, maxInFlightBatches: 4 },
+    { maxMessages: 100, maxInFlightBatches: 4 },
+    { maxMessages: 100, maxInFlightBatches: 16 },
+    { maxMessages: 1000, maxInFlightBatches: 16 },
+];
+
+async function runBench() {
+    console.log(`🚀 Benchmark do Publisher: ${total} mensagens por configuração\n`);
+    console.log('lote   em voo   latência   msgs/s      falhas');
+
+    for (const config of configs) {
+        const publisher = new Publisher(topic, { maxLatencyMs: 5, ...config });
+        const start = process.hrtime.bigint();
+
+        const pending: Array<Promise<{ error?: Error }>> = [];
+        for (let i = 0; i < total; i++) {
+            pending.push(publisher.publish({ tipo: 'bench', numero: i }));
+        }
+        await publisher.flush();
+        const results = await Promise.all(pending);
+
+        const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+        const failures = results.filter((r) => r.error).length;
+        console.log(
+            `${String(config.maxMessages).padEnd(7)}${String(config.maxInFlightBatches).padEnd(9)}` +
+                `${'5 ms'.padEnd(11)}${Math.round(total / seconds)
+                    .toString()
+                    .padEnd(12)}${failures}`,
+        );
+    }
+}
+
+runBench()
+    .catch(console.error)
+    .finally(() => {
+        console.log('\n👋 Benchmark finalizado!');
+        process.exit(0);
+    });
@@ -0,0 +1,1108 @@
+// gcc broker.c -o broker -pthread
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../../comum/alog.h" // Logger assíncrono (ring buffer por thread)
+
+/*
+ * BROKER DE MENSAGENS LOCAL (TCP + epoll)
+ * - Substituto local do Google Cloud Pub/Sub para testes e benchmarks offline.
+ * - Tópicos com várias assinaturas: cada mensagem publicada é entregue a todas (fan-out),
+ *   sem cópia (a mensagem é compartilhada com contagem de referências).
+ * - Cada assinatura controla as mensagens em voo (entregues e sem ACK); mensagens sem ACK
+ *   dentro do prazo, com NACK ou de consumidores desconectados são reentregues.
+ * - Uma única thread com epoll atende todas as conexões (sockets não bloqueantes).
+ * - Com DIR_LOG, cada tópico também é gravado em um log append-only de segmentos
+ *   (DIR_LOG/<tópico>/<offset_base>.log, pré-alocados e mapeados com mmap). O id da
+ *   mensagem é o seu offset no log. Uma thread de flush faz msync em grupo (group commit)
+ *   e só então a resposta do PUBLISH é liberada e as mensagens vão para os consumidores
+ *   (um id entregue nunca é reaproveitado depois de uma queda). Um índice esparso em memória
+ *   (offset -> segmento/posição a cada 4 KB) permite busca binária, e OP_FETCH devolve
+ *   trechos do log com sendfile, direto do page cache. O log é recuperado na inicialização.
+ *
+ * Protocolo binário (mesmo estilo do RPC): header uint32 op + uint32 len (big-endian) + payload
+ *   OP_CREATE_TOPIC = 1  [u16 n][tópico]                               -> OK
+ *   OP_CREATE_SUB   = 2  [u16 n][assinatura][u16 n][tópico]            -> OK
+ *   OP_PUBLISH      = 3  [u16 n][tópico][u32 qtd] qtd x ([u32 n][dados]) -> [u32 qtd][u64 primeiro_id]
+ *                        (qtd da resposta < qtd do pedido: só as primeiras foram gravadas; reenviar o resto)
+ *   OP_SUBSCRIBE    = 4  [u16 n][assinatura][u32 max_em_voo]           -> OK, depois frames DELIVER
+ *   OP_ACK          = 5  [u32 qtd] qtd x [u64 id]                      (sem resposta)
+ *   OP_NACK         = 6  [u32 qtd] qtd x [u64 id]                      (sem resposta)
+ *   OP_EXISTS       = 7  [u8 tipo 0=tópico 1=assinatura][u16 n][nome]  -> [u8 existe]
+ *   OP_LIST         = 8  [u8 tipo][u16 n][tópico (tipo 1)]             -> [u32 qtd] qtd x ([u16 n][nome])
+ *   OP_FETCH        = 9  [u16 n][tópico][u64 offset][u32 max_bytes]    -> [u64 próximo_offset] registros do log
+ *                        registro: [u32 tam_total][u32 soma][u64 offset][u64 publish_ms][dados]
+ *   OP_DELIVER   = 0x40  (broker -> consumidor) [u32 qtd] qtd x ([u64 id][u64 publish_ms][u32 tentativa][u32 n][dados])
+ *   Respostas usam op | 0x80; erros usam OP_ERR (0xFF) com o texto do erro no payload.
+ *
+ * Uso:
+ *   ./broker <PORTA> [PRAZO_ACK_SEG] [DIR_LOG]
+ *
+ * Exemplo:
+ *   ./broker 7000 10
+ *   ./broker 7000 10 ./dados   (mensagens duráveis + replay por offset)
+ */
+
+#define MAX_FRAME         (16u << 20)  // maior payload aceito
+#define MAX_NAME          255          // maior nome de tópico/assinatura
+#define OUT_HIGH          (4u << 20)   // não entrega mais a um consumidor com saída acima disso
+#define DELIVER_MAX_BATCH 256          // mensagens por frame DELIVER
+#define DEFAULT_MAX_OUT   1000         // max_em_voo quando o consumidor informa 0
+#define MAX_EVENTS        256
+#define SEG_SIZE          (64u << 20)  // tamanho de cada segmento do log (pré-alocado)
+#define REC_HDR           24           // [u32 tam_total][u32 soma][u64 offset][u64 publish_ms]
+#define INDEX_INTERVAL    4096         // uma entrada no índice esparso a cada 4 KB de log
+#define SENDFILE_MIN      16384        // respostas de FETCH menores são copiadas do mmap
+
+enum {
+    OP_CREATE_TOPIC = 1, OP_CREATE_SUB = 2, OP_PUBLISH = 3, OP_SUBSCRIBE = 4,
+    OP_ACK = 5, OP_NACK = 6, OP_EXISTS = 7, OP_LIST = 8, OP_FETCH = 9,
+    OP_DELIVER = 0x40, OP_REPLY = 0x80, OP_ERR = 0xFF
+};
+
+typedef struct {
+    uint32_t op;   // big-endian
+    uint32_t len;  // big-endian
+} __attribute__((packed)) frame_hdr_t;
+
+// Mensagem publicada: compartilhada entre as assinaturas do tópico
+typedef struct {
+    uint64_t id, pub_ms;
+    uint32_t refs, len;
+    char data[];
+} msg_t;
+
+typedef struct conn conn_t;
+typedef struct topic topic_t;
+
+typedef struct { msg_t *m; uint32_t attempt; } qent_t;                        // fila de pendentes
+typedef struct { msg_t *m; conn_t *c; uint64_t deadline; uint32_t attempt; } fly_t; // em voo (m == NULL: vazio)
+typedef struct { uint64_t id, deadline; } dl_t;                               // prazos em ordem de entrega
+
+typedef struct sub {
+    char name[MAX_NAME + 1];
+    topic_t *topic;
+    qent_t *q; size_t qhead, qlen, qcap;     // pendentes (ring)
+    fly_t *fly; size_t flylen, flycap;       // em voo: hash aberto id -> entrada
+    dl_t *dl; size_t dlhead, dllen, dlcap;   // prazos (FIFO, entradas já confirmadas são descartadas na leitura)
+    conn_t **cons; int ncons, rr;            // consumidores conectados (round-robin)
+    uint64_t delivered, acked, redelivered;
+    struct sub *next;
+} sub_t;
+
+// Segmento do log: arquivo de SEG_SIZE bytes mapeado inteiro
+typedef struct {
+    int fd;
+    char *base;
+    uint64_t base_off;           // offset do primeiro registro (nome do arquivo)
+    size_t size, written;
+    _Atomic size_t durable;      // bytes já em disco (atualizado pela thread de flush)
+    int dirty;                   // escrito desde o último pedido de flush
+} seg_t;
+
+typedef struct { uint64_t off; uint32_t seg, pos; } idx_t;  // entrada do índice esparso
+
+struct topic {
+    char name[MAX_NAME + 1];
+    uint64_t next_id, published;
+    sub_t **subs; int nsubs;
+    seg_t **segs; int nsegs;                 // log (DIR_LOG)
+    idx_t *idx; size_t nidx, idxcap;
+    uint64_t log_start;                      // primeiro offset presente no log
+    size_t idx_next;                         // posição do próximo registro a indexar
+    uint64_t committed;                      // maior id já em disco: só ele e os anteriores são entregues
+    uint64_t requested;                      // maior id já incluído em um pedido de flush
+    struct gate_s *cm; size_t cmhead, cmlen, cmcap;  // pedidos de flush pendentes: (último id, seq)
+    struct topic *next;
+};
+
+typedef struct sf { int fd; off_t off; size_t left; uint64_t at; struct sf *next; } sf_t;  // sendfile pendente
+typedef struct gate_s { uint64_t at, seq; } gate_t;  // saída (ou id) retida até o flush `seq` terminar
+
+struct conn {
+    int fd;
+    struct sockaddr_in addr;
+    char *in; size_t inlen, incap;
+    char *out; size_t outoff, outlen, outcap;
+    uint64_t obase;              // bytes do buffer de saída já enviados (posições de sf/gates)
+    sf_t *sf, *sf_tail;          // trechos de arquivo a enviar com sendfile, na ordem do fluxo
+    gate_t *gates; size_t ghead, glen, gcap;  // respostas de PUBLISH aguardando o flush
+    int gated;                   // está em gated[]
+    int want_out;                // EPOLLOUT registrado
+    int dead;                    // fechada (liberada no fim da iteração)
+    sub_t *sub;                  // assinatura consumida (SUBSCRIBE)
+    uint32_t max_out, outstanding;
+    conn_t *next_dead;
+};
+
+static volatile sig_atomic_t running = 1;
+static int ep;                               // epoll
+static topic_t *topics;
+static sub_t *subs;
+static uint64_t ack_deadline_ms = 10000;
+static uint64_t now_ms, now_wall_ms;         // relógios da iteração atual
+static conn_t *dead_conns;
+static const char *log_dir;                  // NULL: sem log (somente memória)
+static conn_t **gated; static int ngated, gatedcap;  // conexões com respostas retidas
+
+// Group commit: a thread do broker pede flush dos segmentos sujos; a thread de flush
+// faz msync e avisa pelo eventfd
+typedef struct { seg_t *s; size_t to; } sync_t;
+static struct {
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    sync_t *req; size_t nreq, cap;           // pedidos ainda não atendidos
+    uint64_t req_seq;                        // último pedido
+    _Atomic uint64_t done_seq;               // último pedido em disco
+    int efd, stop;
+} lg = { .mtx = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER };
+static uint64_t lg_next_seq = 1, lg_done;    // (thread do broker) próximo pedido / último concluído
+static seg_t **dirty; static int ndirty, dirtycap;
+
+static void on_sig(int s) { (void) s; running = 0; }
+
+static uint64_t clock_ms(clockid_t id) {
+    struct timespec ts; clock_gettime(id, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static void *xrealloc(void *p, size_t n) {
+    void *q = realloc(p, n);
+    if (!q) { perror("realloc"); exit(1); }
+    return q;
+}
+
+/* ===========================
+ * Leitura/escrita de campos big-endian
+ * =========================== */
+typedef struct { const char *p; size_t left; int bad; } rd_t;
+
+static const char *rd_bytes(rd_t *r, size_t n) {
+    if (r->bad || r->left < n) { r->bad = 1; return NULL; }
+    const char *p = r->p; r->p += n; r->left -= n;
+    return p;
+}
+static uint64_t rd_be(rd_t *r, int n) {
+    const unsigned char *p = (const unsigned char *) rd_bytes(r, (size_t) n);
+    uint64_t v = 0;
+    for (int i = 0; p && i < n; i++) v = (v << 8) | p[i];
+    return v;
+}
+// Lê [u16 n][nome] em buf (terminado em '\0')
+static int rd_name(rd_t *r, char *buf) {
+    size_t n = (size_t) rd_be(r, 2);
+    const char *p = rd_bytes(r, n);
+    if (!p || n == 0 || n > MAX_NAME) { r->bad = 1; return -1; }
+    memcpy(buf, p, n); buf[n] = '\0';
+    return 0;
+}
+static void wr_be(char *p, uint64_t v, int n) {
+    for (int i = n - 1; i >= 0; i--) { p[i] = (char) (v & 0xff); v >>= 8; }
+}
+
+/* ===========================
+ * Buffer de saída por conexão
+ * =========================== */
+static char *out_reserve(conn_t *c, size_t n) {
+    if (c->outoff && c->outoff == c->outlen) c->outoff = c->outlen = 0;
+    if (c->outlen + n > c->outcap) {
+        if (c->outoff) {  // compacta antes de crescer
+            memmove(c->out, c->out + c->outoff, c->outlen - c->outoff);
+            c->outlen -= c->outoff; c->outoff = 0;
+        }
+        size_t cap = c->outcap ? c->outcap : 65536;
+        while (c->outlen + n > cap) cap *= 2;
+        if (cap != c->outcap) { c->out = (char *) xrealloc(c->out, cap); c->outcap = cap; }
+    }
+    char *p = c->out + c->outlen;
+    c->outlen += n;
+    return p;
+}
+
+// Frames montados aos poucos: a posição é relativa a outoff porque out_reserve pode compactar
+static size_t frame_begin(conn_t *c) {
+    return (size_t) (out_reserve(c, sizeof(frame_hdr_t) + 4) - c->out) - c->outoff;
+}
+static void frame_end(conn_t *c, size_t rel, uint32_t op, uint32_t cnt) {
+    char *h = c->out + c->outoff + rel;
+    wr_be(h, op, 4);
+    wr_be(h + 4, c->outlen - c->outoff - rel - sizeof(frame_hdr_t), 4);
+    wr_be(h + 8, cnt, 4);
+}
+
+static void reply(conn_t *c, uint32_t op, const void *payload, size_t len) {
+    char *p = out_reserve(c, sizeof(frame_hdr_t) + len);
+    wr_be(p, op, 4); wr_be(p + 4, len, 4);
+    if (len) memcpy(p + 8, payload, len);
+}
+
+static void reply_err(conn_t *c, const char *msg) {
+    alog_peer_str(ALOG_WARN, "[BROKER] erro para %s:%d: %.*s\n", &c->addr, msg, strlen(msg));
+    reply(c, OP_ERR, msg, strlen(msg));
+}
+
+static void conn_close(conn_t *c);
+
+// Posição (no fluxo do buffer de saída) do próximo byte a ser escrito
+static uint64_t out_pos(const conn_t *c) { return c->obase + (c->outlen - c->outoff); }
+
+// Enfileira um trecho de arquivo para sendfile depois do que já está no buffer
+static void conn_sendfile(conn_t *c, int fd, off_t off, size_t len) {
+    sf_t *f = (sf_t *) xrealloc(NULL, sizeof *f);
+    *f = (sf_t) { fd, off, len, out_pos(c), NULL };
+    if (c->sf_tail) c->sf_tail->next = f; else c->sf = f;
+    c->sf_tail = f;
+}
+
+// Retém a saída a partir daqui até o flush em andamento terminar (resposta de PUBLISH durável)
+static void conn_gate(conn_t *c) {
+    if (c->glen == c->gcap) {
+        c->gcap = c->gcap ? c->gcap * 2 : 16;
+        c->gates = (gate_t *) xrealloc(c->gates, c->gcap * sizeof *c->gates);
+    }
+    c->gates[c->glen++] = (gate_t) { out_pos(c), lg_next_seq };
+    if (!c->gated) {
+        if (ngated == gatedcap) {
+            gatedcap = gatedcap ? gatedcap * 2 : 64;
+            gated = (conn_t **) xrealloc(gated, (size_t) gatedcap * sizeof *gated);
+        }
+        gated[ngated++] = c; c->gated = 1;
+    }
+}
+
+// Envia o que for possível sem bloquear (buffer, trechos de sendfile e retenções, na ordem);
+// registra EPOLLOUT se o socket encheu
+static int conn_flush(conn_t *c) {
+    while (c->ghead < c->glen && c->gates[c->ghead].seq <= lg_done) c->ghead++;
+    if (c->ghead == c->glen) c->ghead = c->glen = 0;
+    int full = 0;
+    for (;;) {
+        uint64_t limit = out_pos(c);
+        if (c->sf && c->sf->at < limit) limit = c->sf->at;
+        if (c->glen && c->gates[c->ghead].at < limit) limit = c->gates[c->ghead].at;
+        ssize_t w;
+        if (c->obase < limit) {
+            w = send(c->fd, c->out + c->outoff, (size_t) (limit - c->obase), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (w > 0) { c->outoff += (size_t) w; c->obase += (uint64_t) w; continue; }
+        } else if (c->sf && c->sf->at == c->obase) {
+            w = sendfile(c->fd, c->sf->fd, &c->sf->off, c->sf->left);
+            if (w > 0 && (c->sf->left -= (size_t) w) == 0) {
+                sf_t *f = c->sf; c->sf = f->next;
+                if (!c->sf) c->sf_tail = NULL;
+                free(f);
+            }
+            if (w > 0) continue;
+        } else {
+            break;  // tudo enviado ou retido até o flush
+        }
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { full = 1; break; }
+        return -1;
+    }
+    int want = full;
+    if (want != c->want_out) {
+        struct epoll_event ev = { .events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = c };
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_out = want;
+    }
+    return 0;
+}
+
+/* ===========================
+ * Tópicos e assinaturas
+ * =========================== */
+static topic_t *topic_find(const char *name) {
+    for (topic_t *t = topics; t; t = t->next) if (!strcmp(t->name, name)) return t;
+    return NULL;
+}
+static sub_t *sub_find(const char *name) {
+    for (sub_t *s = subs; s; s = s->next) if (!strcmp(s->name, name)) return s;
+    return NULL;
+}
+
+static topic_t *topic_create(const char *name) {
+    topic_t *t = topic_find(name);
+    if (t) return t;
+    if (log_dir && (name[0] == '.' || strchr(name, '/'))) return NULL;  // vira diretório do log
+    if (log_dir) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof path, "%s/%s", log_dir, name);
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) { perror("mkdir"); return NULL; }
+    }
+    t = (topic_t *) calloc(1, sizeof *t);
+    snprintf(t->name, sizeof t->name, "%s", name);
+    t->next_id = t->log_start = 1;
+    t->next = topics; topics = t;
+    alog_str(ALOG_INFO, "[BROKER] tópico criado: %.*s\n", name, strlen(name));
+    return t;
+}
+
+static void msg_unref(msg_t *m) { if (--m->refs == 0) free(m); }
+
+// Fila de pendentes (ring que cresce em potências de 2)
+static void q_push(sub_t *s, msg_t *m, uint32_t attempt) {
+    if (s->qlen == s->qcap) {
+        size_t cap = s->qcap ? s->qcap * 2 : 1024;
+        qent_t *q = (qent_t *) xrealloc(NULL, cap * sizeof *q);
+        for (size_t i = 0; i < s->qlen; i++) q[i] = s->q[(s->qhead + i) & (s->qcap - 1)];
+        free(s->q); s->q = q; s->qcap = cap; s->qhead = 0;
+    }
+    s->q[(s->qhead + s->qlen++) & (s->qcap - 1)] = (qent_t) { m, attempt };
+}
+static qent_t q_pop(sub_t *s) {
+    qent_t e = s->q[s->qhead];
+    s->qhead = (s->qhead + 1) & (s->qcap - 1); s->qlen--;
+    return e;
+}
+
+// Tabela de mensagens em voo: endereçamento aberto, sondagem linear, remoção por deslocamento
+static size_t fly_home(const sub_t *s, uint64_t id) {
+    return (size_t) ((id * 0x9E3779B97F4A7C15ull) >> 20) & (s->flycap - 1);
+}
+static long fly_find(const sub_t *s, uint64_t id) {
+    if (!s->flycap) return -1;
+    for (size_t i = fly_home(s, id);; i = (i + 1) & (s->flycap - 1)) {
+        if (!s->fly[i].m) return -1;
+        if (s->fly[i].m->id == id) return (long) i;
+    }
+}
+static void fly_put(sub_t *s, fly_t e) {
+    if ((s->flylen + 1) * 2 > s->flycap) {
+        fly_t *old = s->fly; size_t oldcap = s->flycap;
+        s->flycap = oldcap ? oldcap * 2 : 1024;
+        s->fly = (fly_t *) calloc(s->flycap, sizeof *s->fly);
+        s->flylen = 0;
+        for (size_t i = 0; i < oldcap; i++) if (old[i].m) fly_put(s, old[i]);
+        free(old);
+    }
+    size_t i = fly_home(s, e.m->id);
+    while (s->fly[i].m) i = (i + 1) & (s->flycap - 1);
+    s->fly[i] = e; s->flylen++;
+}
+static void fly_del(sub_t *s, size_t i) {
+    size_t mask = s->flycap - 1, j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!s->fly[j].m) break;
+        size_t k = fly_home(s, s->fly[j].m->id);
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;  // já está no lugar certo
+        s->fly[i] = s->fly[j]; i = j;
+    }
+    s->fly[i].m = NULL; s->flylen--;
+}
+
+static void dl_push(sub_t *s, uint64_t id, uint64_t deadline) {
+    if (s->dllen == s->dlcap) {
+        size_t cap = s->dlcap ? s->dlcap * 2 : 1024;
+        dl_t *d = (dl_t *) xrealloc(NULL, cap * sizeof *d);
+        for (size_t i = 0; i < s->dllen; i++) d[i] = s->dl[(s->dlhead + i) & (s->dlcap - 1)];
+        free(s->dl); s->dl = d; s->dlcap = cap; s->dlhead = 0;
+    }
+    s->dl[(s->dlhead + s->dllen++) & (s->dlcap - 1)] = (dl_t) { id, deadline };
+}
+
+static sub_t *sub_create(const char *name, topic_t *t) {
+    sub_t *s = (sub_t *) calloc(1, sizeof *s);
+    snprintf(s->name, sizeof s->name, "%s", name);
+    s->topic = t;
+    s->next = subs; subs = s;
+    t->subs = (sub_t **) xrealloc(t->subs, sizeof *t->subs * (size_t) (t->nsubs + 1));
+    t->subs[t->nsubs++] = s;
+    alog_str(ALOG_INFO, "[BROKER] assinatura criada: %.*s\n", name, strlen(name));
+    return s;
+}
+
+// Tira a mensagem de "em voo" e devolve à fila (NACK, prazo vencido ou consumidor caiu)
+static void fly_requeue(sub_t *s, size_t i) {
+    fly_t e = s->fly[i];
+    if (e.c) e.c->outstanding--;
+    fly_del(s, i);
+    q_push(s, e.m, e.attempt + 1);
+}
+
+// Confirma (ACK) uma mensagem em voo
+static void sub_ack(sub_t *s, uint64_t id) {
+    long i = fly_find(s, id);
+    if (i < 0) return;  // já confirmada ou reentregue
+    fly_t e = s->fly[i];
+    if (e.c) e.c->outstanding--;
+    fly_del(s, (size_t) i);
+    s->acked++;
+    msg_unref(e.m);
+}
+
+// Reentrega mensagens cujo prazo de ACK venceu; descarta prazos de mensagens já confirmadas
+static void sub_expire(sub_t *s) {
+    while (s->dllen) {
+        dl_t d = s->dl[s->dlhead];
+        long i = fly_find(s, d.id);
+        if (i >= 0 && s->fly[i].deadline == d.deadline) {
+            if (d.deadline > now_ms) break;
+            alog_num(ALOG_DEBUG, "[BROKER] prazo de ACK vencido, reentregando id=%llu\n", d.id);
+            fly_requeue(s, (size_t) i);
+        }
+        s->dlhead = (s->dlhead + 1) & (s->dlcap - 1); s->dllen--;
+    }
+}
+
+// Próxima pendente pode sair: com DIR_LOG, só depois do msync que a tornou durável
+static int sub_ready(const sub_t *s) {
+    return s->qlen && (!log_dir || s->q[s->qhead].m->id <= s->topic->committed);
+}
+
+// Entrega pendentes aos consumidores com crédito, em frames DELIVER de até DELIVER_MAX_BATCH
+static void sub_pump(sub_t *s) {
+    while (sub_ready(s) && s->ncons) {
+        conn_t *c = NULL;
+        for (int k = 0; k < s->ncons; k++) {
+            conn_t *x = s->cons[(s->rr + k) % s->ncons];
+            if (x->outstanding < x->max_out && x->outlen - x->outoff < OUT_HIGH) {
+                c = x; s->rr = (s->rr + k + 1) % s->ncons;
+                break;
+            }
+        }
+        if (!c) break;  // ninguém com crédito
+
+        size_t start = frame_begin(c);
+        uint32_t cnt = 0;
+        while (sub_ready(s) && cnt < DELIVER_MAX_BATCH && c->outstanding < c->max_out) {
+            qent_t e = q_pop(s);
+            char *p = out_reserve(c, 24 + e.m->len);
+            wr_be(p, e.m->id, 8); wr_be(p + 8, e.m->pub_ms, 8);
+            wr_be(p + 16, e.attempt, 4); wr_be(p + 20, e.m->len, 4);
+            memcpy(p + 24, e.m->data, e.m->len);
+            uint64_t deadline = now_ms + ack_deadline_ms;
+            fly_put(s, (fly_t) { e.m, c, deadline, e.attempt });
+            dl_push(s, e.m->id, deadline);
+            c->outstanding++; cnt++;
+            s->delivered++;
+            if (e.attempt > 1) s->redelivered++;
+        }
+        frame_end(c, start, OP_DELIVER, cnt);
+    }
+}
+
+/* ===========================
+ * Log durável (DIR_LOG)
+ * =========================== */
+// Soma de verificação do registro (FNV-1a 32 bits sobre offset + dados)
+static uint32_t rec_sum(uint64_t off, const char *d, size_t n) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 8; i++) { h ^= (uint8_t) (off >> (8 * i)); h *= 16777619u; }
+    for (size_t i = 0; i < n; i++) { h ^= (uint8_t) d[i]; h *= 16777619u; }
+    return h;
+}
+
+// Abre (create=0, recuperação) ou cria um segmento pré-alocado e o mapeia inteiro
+static seg_t *seg_open(topic_t *t, uint64_t base_off, int create) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%s/%020llu.log", log_dir, t->name, (unsigned long long) base_off);
+    int fd = open(path, O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if (fd < 0) { perror("open"); return NULL; }
+    struct stat st;
+    size_t size = SEG_SIZE;
+    if (create) {
+        int e = posix_fallocate(fd, 0, SEG_SIZE);  // blocos reservados: sem ENOSPC no meio do mmap
+        if (e) { errno = e; perror("posix_fallocate"); close(fd); unlink(path); return NULL; }
+    } else {
+        if (fstat(fd, &st) < 0 || st.st_size < REC_HDR) { close(fd); return NULL; }
+        size = (size_t) st.st_size;
+    }
+    char *base = (char *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) { perror("mmap"); close(fd); return NULL; }
+    if (create) {  // o novo arquivo precisa sobreviver a uma queda: sincroniza o diretório
+        snprintf(path, sizeof path, "%s/%s", log_dir, t->name);
+        int dfd = open(path, O_RDONLY | O_DIRECTORY);
+        if (dfd >= 0) { fsync(dfd); close(dfd); }
+    }
+
+    seg_t *sg = (seg_t *) calloc(1, sizeof *sg);
+    sg->fd = fd; sg->base = base; sg->base_off = base_off; sg->size = size;
+    t->segs = (seg_t **) xrealloc(t->segs, sizeof *t->segs * (size_t) (t->nsegs + 1));
+    t->segs[t->nsegs++] = sg;
+    t->idx_next = 0;
+    return sg;
+}
+
+static void idx_push(topic_t *t, uint64_t off, size_t pos) {
+    if (t->nidx == t->idxcap) {
+        t->idxcap = t->idxcap ? t->idxcap * 2 : 1024;
+        t->idx = (idx_t *) xrealloc(t->idx, t->idxcap * sizeof *t->idx);
+    }
+    t->idx[t->nidx++] = (idx_t) { off, (uint32_t) (t->nsegs - 1), (uint32_t) pos };
+    t->idx_next = pos + INDEX_INTERVAL;
+}
+
+// Acrescenta um registro ao segmento ativo (cria o próximo se não couber)
+static int log_append(topic_t *t, uint64_t off, uint64_t pub_ms, const char *d, uint32_t n) {
+    size_t need = REC_HDR + (size_t) n;
+    seg_t *sg = t->nsegs ? t->segs[t->nsegs - 1] : NULL;
+    if (!sg || sg->written + need > sg->size) {
+        if (!(sg = seg_open(t, off, 1))) return -1;
+        alog_num(ALOG_INFO, "[BROKER] novo segmento do log a partir do offset %llu\n", off);
+    }
+    if (sg->written >= t->idx_next) idx_push(t, off, sg->written);
+    char *p = sg->base + sg->written;
+    wr_be(p + 4, rec_sum(off, d, n), 4); wr_be(p + 8, off, 8); wr_be(p + 16, pub_ms, 8);
+    memcpy(p + REC_HDR, d, n);
+    wr_be(p, need, 4);  // tamanho nunca é 0: 0 marca o fim do segmento
+    sg->written += need;
+    if (!sg->dirty) {
+        if (ndirty == dirtycap) {
+            dirtycap = dirtycap ? dirtycap * 2 : 16;
+            dirty = (seg_t **) xrealloc(dirty, (size_t) dirtycap * sizeof *dirty);
+        }
+        dirty[ndirty++] = sg; sg->dirty = 1;
+    }
+    return 0;
+}
+
+// Fim da iteração: pede à thread de flush um msync de tudo que foi escrito (um pedido por iteração)
+static void log_request_sync(void) {
+    if (!ndirty) return;
+    pthread_mutex_lock(&lg.mtx);
+    for (int i = 0; i < ndirty; i++) {
+        seg_t *sg = dirty[i];
+        size_t k = 0;
+        while (k < lg.nreq && lg.req[k].s != sg) k++;  // segmento já pedido: só avança o fim
+        if (k == lg.nreq) {
+            if (lg.nreq == lg.cap) {
+                lg.cap = lg.cap ? lg.cap * 2 : 16;
+                lg.req = (sync_t *) xrealloc(lg.req, lg.cap * sizeof *lg.req);
+            }
+            lg.nreq++;
+        }
+        lg.req[k] = (sync_t) { sg, sg->written };
+        sg->dirty = 0;
+    }
+    lg.req_seq = lg_next_seq++;
+    pthread_cond_signal(&lg.cv);
+    pthread_mutex_unlock(&lg.mtx);
+    ndirty = 0;
+
+    // Guarda, por tópico, até que id este pedido torna durável (entregas esperam por ele)
+    for (topic_t *t = topics; t; t = t->next) {
+        if (t->next_id - 1 <= t->requested) continue;
+        if (t->cmlen == t->cmcap) {
+            size_t cap = t->cmcap ? t->cmcap * 2 : 16;
+            gate_t *q = (gate_t *) xrealloc(NULL, cap * sizeof *q);
+            for (size_t i = 0; i < t->cmlen; i++) q[i] = t->cm[(t->cmhead + i) & (t->cmcap - 1)];
+            free(t->cm); t->cm = q; t->cmcap = cap; t->cmhead = 0;
+        }
+        t->requested = t->next_id - 1;
+        t->cm[(t->cmhead + t->cmlen++) & (t->cmcap - 1)] = (gate_t) { t->requested, lg_next_seq - 1 };
+    }
+}
+
+// Thread de flush: cada rodada sincroniza tudo que foi pedido enquanto a anterior rodava
+static void *log_flusher(void *p) {
+    (void) p;
+    sigset_t all; sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    long page = sysconf(_SC_PAGESIZE);
+    sync_t *work = NULL; size_t cap = 0;
+    for (;;) {
+        pthread_mutex_lock(&lg.mtx);
+        while (!lg.nreq && !lg.stop) pthread_cond_wait(&lg.cv, &lg.mtx);
+        if (!lg.nreq) { pthread_mutex_unlock(&lg.mtx); break; }
+        if (cap < lg.nreq) { cap = lg.nreq; work = (sync_t *) xrealloc(work, cap * sizeof *work); }
+        size_t n = lg.nreq;
+        memcpy(work, lg.req, n * sizeof *work);
+        uint64_t seq = lg.req_seq;
+        lg.nreq = 0;
+        pthread_mutex_unlock(&lg.mtx);
+
+        for (size_t i = 0; i < n; i++) {
+            seg_t *sg = work[i].s;
+            size_t from = atomic_load(&sg->durable) & ~((size_t) page - 1);
+            if (work[i].to <= from) continue;
+            if (msync(sg->base + from, work[i].to - from, MS_SYNC) < 0)
+                alog_txt(ALOG_ERROR, "[BROKER] msync falhou; dados podem não estar em disco\n");
+            atomic_store(&sg->durable, work[i].to);
+        }
+        atomic_store(&lg.done_seq, seq);
+        uint64_t one = 1;
+        if (write(lg.efd, &one, sizeof one) < 0) { /* contador do eventfd saturado: já há aviso pendente */ }
+    }
+    free(work);
+    return NULL;
+}
+
+// eventfd: um flush terminou; libera as respostas retidas
+static void log_committed(void) {
+    uint64_t v;
+    if (read(lg.efd, &v, sizeof v) < 0) return;
+    lg_done = atomic_load(&lg.done_seq);
+    for (topic_t *t = topics; t; t = t->next)  // avança o id durável; sub_pump entrega até ele
+        while (t->cmlen && t->cm[t->cmhead].seq <= lg_done) {
+            t->committed = t->cm[t->cmhead].at;
+            t->cmhead = (t->cmhead + 1) & (t->cmcap - 1); t->cmlen--;
+        }
+    for (int i = ngated - 1; i >= 0; i--) {  // conn_close e a remoção trocam gated[i] pelo último (já visto)
+        conn_t *c = gated[i];
+        if (conn_flush(c) < 0) { conn_close(c); continue; }
+        if (!c->glen) { gated[i] = gated[--ngated]; c->gated = 0; }
+    }
+}
+
+// Localiza o registro `off`: busca binária no índice esparso + varredura curta no segmento
+static int log_seek(const topic_t *t, uint64_t off, seg_t **sg_out, size_t *pos_out) {
+    if (!t->nidx || off < t->log_start || off >= t->next_id) return 0;
+    size_t lo = 0, hi = t->nidx;  // última entrada com idx.off <= off
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (t->idx[mid].off <= off) lo = mid; else hi = mid;
+    }
+    seg_t *sg = t->segs[t->idx[lo].seg];
+    size_t pos = t->idx[lo].pos;
+    for (uint64_t o = t->idx[lo].off; o < off; o++) {
+        rd_t h = { sg->base + pos, REC_HDR, 0 };
+        pos += (size_t) rd_be(&h, 4);
+    }
+    *sg_out = sg; *pos_out = pos;
+    return 1;
+}
+
+// Valida os registros de um segmento recuperado; retorna -1 se parou em um registro inválido
+static int seg_scan(topic_t *t, seg_t *sg) {
+    size_t pos = 0;
+    while (pos + REC_HDR <= sg->size) {
+        rd_t h = { sg->base + pos, REC_HDR, 0 };
+        size_t len = (size_t) rd_be(&h, 4);
+        uint32_t sum = (uint32_t) rd_be(&h, 4);
+        uint64_t off = rd_be(&h, 8);
+        if (len == 0) break;  // fim do segmento
+        if (len < REC_HDR || pos + len > sg->size || (t->nidx && off != t->next_id) ||
+            (!t->nidx && off != sg->base_off) || rec_sum(off, sg->base + pos + REC_HDR, len - REC_HDR) != sum) {
+            sg->written = pos;
+            return -1;
+        }
+        if (!t->nidx) t->log_start = off;
+        if (pos >= t->idx_next) idx_push(t, off, pos);
+        t->next_id = off + 1;
+        pos += len;
+    }
+    sg->written = pos;
+    return 0;
+}
+
+static int name_cmp(const void *a, const void *b) { return strcmp(*(char *const *) a, *(char *const *) b); }
+
+// Reabre os tópicos e segmentos de DIR_LOG; descarta o que vier depois de um registro inválido
+static int log_recover(void) {
+    DIR *d = opendir(log_dir);
+    if (!d) { perror(log_dir); return -1; }
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.' || strlen(e->d_name) > MAX_NAME) continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof path, "%s/%s", log_dir, e->d_name);
+        DIR *td = opendir(path);
+        if (!td) continue;
+        topic_t *t = topic_create(e->d_name);
+        char **files = NULL; size_t nf = 0;
+        struct dirent *f;
+        while ((f = readdir(td))) {
+            size_t n = strlen(f->d_name);
+            if (n != 24 || strcmp(f->d_name + 20, ".log")) continue;
+            files = (char **) xrealloc(files, (nf + 1) * sizeof *files);
+            files[nf++] = strdup(f->d_name);
+        }
+        closedir(td);
+        qsort(files, nf, sizeof *files, name_cmp);  // nomes com zeros à esquerda: ordem = ordem de offset
+
+        int bad = 0;
+        for (size_t i = 0; i < nf; i++) {
+            seg_t *sg = bad || !t ? NULL : seg_open(t, strtoull(files[i], NULL, 10), 0);
+            if (!sg || seg_scan(t, sg) < 0) {
+                if (sg) {  // zera a cauda inválida: novas escritas continuam daqui
+                    memset(sg->base + sg->written, 0, sg->size - sg->written);
+                    msync(sg->base, sg->size, MS_SYNC);
+                    alog_str(ALOG_WARN, "[BROKER] registro inválido no log, truncando %.*s\n", files[i], strlen(files[i]));
+                } else if (t) {
+                    snprintf(path, sizeof path, "%s/%s/%s", log_dir, t->name, files[i]);
+                    unlink(path);
+                }
+                bad = 1;
+            }
+            if (sg) atomic_store(&sg->durable, sg->written);
+            free(files[i]);
+        }
+        free(files);
+        if (t) t->committed = t->requested = t->next_id - 1;  // tudo que foi recuperado está em disco
+        if (t && t->nidx)
+            fprintf(stderr, "[BROKER] log de %s recuperado: offsets %llu..%llu em %d segmento(s)\n", t->name,
+                (unsigned long long) t->log_start, (unsigned long long) t->next_id - 1, t->nsegs);
+    }
+    closedir(d);
+    return 0;
+}
+
+/* ===========================
+ * Tratamento das operações
+ * =========================== */
+static void op_publish(conn_t *c, rd_t *r) {
+    char name[MAX_NAME + 1];
+    if (rd_name(r, name) < 0) { reply_err(c, "publish: tópico inválido"); return; }
+    uint32_t cnt = (uint32_t) rd_be(r, 4);
+    topic_t *t = topic_find(name);
+    if (!t) { reply_err(c, "publish: tópico não existe"); return; }
+
+    // 1ª passada: confere todos os prefixos e corpos antes de aplicar qualquer mensagem
+    // (lote truncado não pode deixar as primeiras gravadas e entregues: o cliente repetiria o lote)
+    rd_t chk = *r;
+    for (uint32_t k = 0; k < cnt; k++) {
+        uint32_t n = (uint32_t) rd_be(&chk, 4);
+        if (!rd_bytes(&chk, n)) { reply_err(c, "publish: lote truncado"); return; }
+    }
+
+    uint64_t first = t->next_id;
+    uint32_t k;
+    for (k = 0; k < cnt; k++) {
+        uint32_t n = (uint32_t) rd_be(r, 4);
+        const char *d = rd_bytes(r, n);
+        uint64_t id = t->next_id;
+        if (log_dir && log_append(t, id, now_wall_ms, d, n) < 0) {
+            // Falha no meio do lote: as k primeiras já estão no log; responde com k para o
+            // cliente reenviar só o resto
+            if (!k) { reply_err(c, "publish: falha ao gravar no log"); return; }
+            alog_num(ALOG_WARN, "[BROKER] publish: falha ao gravar no log após %llu mensagens do lote\n", k);
+            break;
+        }
+        t->next_id++;
+        t->published++;
+        if (!t->nsubs) continue;  // sem assinaturas: a mensagem só fica no log (se houver)
+        msg_t *m = (msg_t *) malloc(sizeof *m + n);
+        m->id = id; m->pub_ms = now_wall_ms; m->len = n;
+        m->refs = (uint32_t) t->nsubs;
+        memcpy(m->data, d, n);
+        for (int i = 0; i < t->nsubs; i++) q_push(t->subs[i], m, 1);  // fan-out sem cópia
+    }
+    char out[12];
+    wr_be(out, k, 4); wr_be(out + 4, first, 8);
+    if (log_dir && k) conn_gate(c);  // a resposta só sai depois do msync (group commit)
+    reply(c, OP_PUBLISH | OP_REPLY, out, sizeof out);
+}
+
+static void op_subscribe(conn_t *c, rd_t *r) {
+    char name[MAX_NAME + 1];
+    if (rd_name(r, name) < 0) { reply_err(c, "subscribe: assinatura inválida"); return; }
+    uint32_t max_out = (uint32_t) rd_be(r, 4);
+    sub_t *s = sub_find(name);
+    if (!s) { reply_err(c, "subscribe: assinatura não existe"); return; }
+    if (c->sub) { reply_err(c, "subscribe: conexão já consome uma assinatura"); return; }
+    c->sub = s; c->max_out = max_out ? max_out : DEFAULT_MAX_OUT;
+    s->cons = (conn_t **) xrealloc(s->cons, sizeof *s->cons * (size_t) (s->ncons + 1));
+    s->cons[s->ncons++] = c;
+    alog_peer_str(ALOG_INFO, "[BROKER] %s:%d consumindo %.*s\n", &c->addr, name, strlen(name));
+    reply(c, OP_SUBSCRIBE | OP_REPLY, NULL, 0);
+}
+
+static void op_ack(conn_t *c, rd_t *r, int nack) {
+    uint32_t cnt = (uint32_t) rd_be(r, 4);
+    if (!c->sub) return;
+    for (uint32_t k = 0; k < cnt && !r->bad; k++) {
+        uint64_t id = rd_be(r, 8);
+        if (r->bad) break;
+        if (!nack) { sub_ack(c->sub, id); continue; }
+        long i = fly_find(c->sub, id);
+        if (i >= 0) fly_requeue(c->sub, (size_t) i);
+    }
+}
+
+static void op_list(conn_t *c, rd_t *r) {
+    int kind = (int) rd_be(r, 1);
+    char tname[MAX_NAME + 1] = "";
+    if (kind == 1 && rd_name(r, tname) < 0) { reply_err(c, "list: tópico inválido"); return; }
+    // Monta a resposta direto no buffer de saída
+    size_t start = frame_begin(c);
+    uint32_t cnt = 0;
+    if (kind == 0) {
+        for (topic_t *t = topics; t; t = t->next, cnt++) {
+            size_t n = strlen(t->name); char *p = out_reserve(c, 2 + n);
+            wr_be(p, n, 2); memcpy(p + 2, t->name, n);
+        }
+    } else {
+        topic_t *t = topic_find(tname);
+        for (int i = 0; t && i < t->nsubs; i++, cnt++) {
+            size_t n = strlen(t->subs[i]->name); char *p = out_reserve(c, 2 + n);
+            wr_be(p, n, 2); memcpy(p + 2, t->subs[i]->name, n);
+        }
+    }
+    frame_end(c, start, OP_LIST | OP_REPLY, cnt);
+}
+
+// Devolve registros a partir de `offset` (até max_bytes, ao menos um) do segmento que o contém
+static void op_fetch(conn_t *c, rd_t *r) {
+    char name[MAX_NAME + 1];
+    if (rd_name(r, name) < 0) { reply_err(c, "fetch: tópico inválido"); return; }
+    uint64_t off = rd_be(r, 8);
+    size_t max = (size_t) rd_be(r, 4);
+    if (r->bad) { reply_err(c, "fetch: requisição truncada"); return; }
+    if (!log_dir) { reply_err(c, "fetch: broker sem log (inicie com DIR_LOG)"); return; }
+    topic_t *t = topic_find(name);
+    if (!t) { reply_err(c, "fetch: tópico não existe"); return; }
+
+    if (off < t->log_start) off = t->log_start;
+    seg_t *sg = NULL;
+    size_t pos = 0, end = 0;
+    uint64_t next = off;
+    if (log_seek(t, off, &sg, &pos)) {
+        // Só entrega o que já está em disco; o trecho termina em fronteira de registro
+        size_t durable = atomic_load(&sg->durable);
+        end = pos;
+        while (end + REC_HDR <= durable) {
+            rd_t h = { sg->base + end, REC_HDR, 0 };
+            size_t len = (size_t) rd_be(&h, 4);
+            if (!len || end + len > durable || (end > pos && end - pos + len > max)) break;
+            end += len; next++;
+        }
+    }
+    char *p = out_reserve(c, sizeof(frame_hdr_t) + 8);
+    wr_be(p, OP_FETCH | OP_REPLY, 4); wr_be(p + 4, 8 + (end - pos), 4); wr_be(p + 8, next, 8);
+    if (end - pos < SENDFILE_MIN) {
+        if (end > pos) memcpy(out_reserve(c, end - pos), sg->base + pos, end - pos);
+    } else {
+        conn_sendfile(c, sg->fd, (off_t) pos, end - pos);  // direto do page cache para o socket
+    }
+}
+
+static void handle_frame(conn_t *c, uint32_t op, const char *payload, uint32_t len) {
+    rd_t r = { payload, len, 0 };
+    char name[MAX_NAME + 1], tname[MAX_NAME + 1];
+    switch (op) {
+    case OP_CREATE_TOPIC:
+        if (rd_name(&r, name) < 0 || !topic_create(name)) { reply_err(c, "create_topic: nome inválido"); return; }
+        reply(c, op | OP_REPLY, NULL, 0);
+        break;
+    case OP_CREATE_SUB: {
+        if (rd_name(&r, name) < 0 || rd_name(&r, tname) < 0) { reply_err(c, "create_sub: nome inválido"); return; }
+        topic_t *t = topic_find(tname);
+        if (!t) { reply_err(c, "create_sub: tópico não existe"); return; }
+        sub_t *s = sub_find(name);
+        if (s && s->topic != t) { reply_err(c, "create_sub: assinatura pertence a outro tópico"); return; }
+        if (!s) sub_create(name, t);
+        reply(c, op | OP_REPLY, NULL, 0);
+        break;
+    }
+    case OP_PUBLISH:   op_publish(c, &r); break;
+    case OP_SUBSCRIBE: op_subscribe(c, &r); break;
+    case OP_ACK:       op_ack(c, &r, 0); break;
+    case OP_NACK:      op_ack(c, &r, 1); break;
+    case OP_EXISTS: {
+        int kind = (int) rd_be(&r, 1);
+        if (rd_name(&r, name) < 0) { reply_err(c, "exists: nome inválido"); return; }
+        uint8_t ok = kind == 0 ? topic_find(name) != NULL : sub_find(name) != NULL;
+        reply(c, op | OP_REPLY, &ok, 1);
+        break;
+    }
+    case OP_LIST: op_list(c, &r); break;
+    case OP_FETCH: op_fetch(c, &r); break;
+    default:
+        reply_err(c, "op desconhecida");
+    }
+}
+
+/* ===========================
+ * Conexões
+ * =========================== */
+static void conn_close(conn_t *c) {
+    if (c->dead) return;
+    c->dead = 1;
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    sub_t *s = c->sub;
+    if (s) {
+        for (int i = 0; i < s->ncons; i++)
+            if (s->cons[i] == c) { s->cons[i] = s->cons[--s->ncons]; break; }
+        // Mensagens em voo deste consumidor voltam para a fila imediatamente
+        for (size_t i = 0; i < s->flycap;) {
+            if (s->fly[i].m && s->fly[i].c == c) fly_requeue(s, i);  // o deslocamento pode trazer outra entrada para i
+            else i++;
+        }
+    }
+    for (int i = 0; c->gated && i < ngated; i++)
+        if (gated[i] == c) { gated[i] = gated[--ngated]; c->gated = 0; }
+    alog_peer(ALOG_INFO, "[BROKER] %s:%d desconectado\n", &c->addr);
+    c->next_dead = dead_conns; dead_conns = c;  // libera no fim da iteração (pode haver eventos pendentes)
+}
+
+static void conn_read(conn_t *c) {
+    int eof = 0;
+    for (;;) {
+        if (c->incap - c->inlen < 65536) {
+            c->incap = c->incap ? c->incap * 2 : 262144;
+            c->in = (char *) xrealloc(c->in, c->incap);
+        }
+        ssize_t r = recv(c->fd, c->in + c->inlen, c->incap - c->inlen, MSG_DONTWAIT);
+        if (r == 0) { eof = 1; break; }  // processa o que já chegou antes de fechar
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            conn_close(c); return;
+        }
+        c->inlen += (size_t) r;
+        if ((size_t) r < 65536) break;  // leitura curta: o socket provavelmente esvaziou
+    }
+
+    // Processa todos os frames completos do buffer
+    size_t off = 0;
+    while (c->inlen - off >= sizeof(frame_hdr_t)) {
+        rd_t r = { c->in + off, sizeof(frame_hdr_t), 0 };
+        uint32_t op = (uint32_t) rd_be(&r, 4), len = (uint32_t) rd_be(&r, 4);
+        if (len > MAX_FRAME) {
+            alog_peer(ALOG_WARN, "[BROKER] frame grande demais de %s:%d\n", &c->addr);
+            conn_close(c); return;
+        }
+        if (c->inlen - off < sizeof(frame_hdr_t) + len) break;  // frame incompleto
+        handle_frame(c, op, c->in + off + sizeof(frame_hdr_t), len);
+        off += sizeof(frame_hdr_t) + len;
+    }
+    if (off) { memmove(c->in, c->in + off, c->inlen - off); c->inlen -= off; }
+    if (conn_flush(c) < 0 || eof) conn_close(c);
+}
+
+static void accept_all(int lfd) {
+    for (;;) {
+        struct sockaddr_in cli; socklen_t cl = sizeof cli;
+        int fd = accept4(lfd, (struct sockaddr *) &cli, &cl, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        int one = 1; setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        conn_t *c = (conn_t *) calloc(1, sizeof *c);
+        c->fd = fd; c->addr = cli;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+        alog_peer(ALOG_INFO, "[BROKER] %s:%d conectado\n", &cli);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "uso: %s <porta> [prazo_ack_seg] [dir_log]\n", argv[0]);
+        return 1;
+    }
+    int port = atoi(argv[1]);
+    if (argc >= 3) ack_deadline_ms = (uint64_t) atoi(argv[2]) * 1000;
+    if (argc == 4) log_dir = argv[3];
+
+    struct sigaction sa = { 0 };
+    sa.sa_handler = on_sig;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (lfd < 0) { perror("socket"); return 1; }
+    int opt = 1; setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof opt);
+
+    struct sockaddr_in srv = { 0 };
+    srv.sin_family = AF_INET;
+    srv.sin_addr.s_addr = INADDR_ANY;
+    srv.sin_port = htons(port);
+    if (bind(lfd, (struct sockaddr *) &srv, sizeof srv) < 0) { perror("bind"); return 1; }
+    if (listen(lfd, 512) < 0) { perror("listen"); return 1; }
+
+    ep = epoll_create1(0);
+    if (ep < 0) { perror("epoll_create1"); return 1; }
+    struct epoll_event lev = { .events = EPOLLIN, .data.ptr = NULL };  // ptr NULL = socket de escuta
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &lev);
+
+    fprintf(stderr, "[BROKER] escutando 0.0.0.0:%d (prazo de ACK %llus)\n", port,
+        (unsigned long long) ack_deadline_ms / 1000);
+    if (alog_init() < 0) { fprintf(stderr, "[BROKER] falha ao iniciar logger\n"); return 1; }
+
+    pthread_t flusher;
+    if (log_dir) {
+        if (mkdir(log_dir, 0755) < 0 && errno != EEXIST) { perror(log_dir); return 1; }
+        if (log_recover() < 0) return 1;
+        lg.efd = eventfd(0, EFD_NONBLOCK);
+        if (lg.efd < 0) { perror("eventfd"); return 1; }
+        struct epoll_event eev = { .events = EPOLLIN, .data.ptr = &lg };  // ptr &lg = flush concluído
+        epoll_ctl(ep, EPOLL_CTL_ADD, lg.efd, &eev);
+        if (pthread_create(&flusher, NULL, log_flusher, NULL) != 0) { perror("pthread_create"); return 1; }
+        fprintf(stderr, "[BROKER] log durável em %s\n", log_dir);
+    }
+
+    // Loop de eventos: I/O, depois prazos e entregas de todas as assinaturas
+    struct epoll_event evs[MAX_EVENTS];
+    while (running) {
+        int n = epoll_wait(ep, evs, MAX_EVENTS, 100);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait"); break;
+        }
+        now_ms = clock_ms(CLOCK_MONOTONIC);
+        now_wall_ms = clock_ms(CLOCK_REALTIME);
+
+        for (int i = 0; i < n; i++) {
+            conn_t *c = (conn_t *) evs[i].data.ptr;
+            if (!c) { accept_all(lfd); continue; }
+            if ((void *) c == &lg) { log_committed(); continue; }
+            if (c->dead) continue;
+            if (evs[i].events & EPOLLOUT && conn_flush(c) < 0) { conn_close(c); continue; }
+            if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) conn_read(c);
+        }
+
+        if (log_dir) log_request_sync();
+
+        for (sub_t *s = subs; s; s = s->next) {
+            sub_expire(s);
+            if (!s->qlen || !s->ncons) continue;
+            sub_pump(s);
+            for (int i = 0; i < s->ncons; i++)
+                if (conn_flush(s->cons[i]) < 0) conn_close(s->cons[i--]);  // close remove cons[i]
+        }
+
+        while (dead_conns) {
+            conn_t *c = dead_conns; dead_conns = c->next_dead;
+            while (c->sf) { sf_t *f = c->sf; c->sf = f->next; free(f); }
+            free(c->in); free(c->out); free(c->gates); free(c);
+        }
+    }
+
+    if (log_dir) {  // a thread de flush atende o último pedido antes de sair
+        pthread_mutex_lock(&lg.mtx);
+        lg.stop = 1;
+        pthread_cond_signal(&lg.cv);
+        pthread_mutex_unlock(&lg.mtx);
+        pthread_join(flusher, NULL);
+    }
+    alog_shutdown();
+    for (topic_t *t = topics; t; t = t->next) {
+        fprintf(stderr, "[BROKER] tópico %s: %llu publicadas\n", t->name, (unsigned long long) t->published);
+        for (int i = 0; i < t->nsegs; i++) { munmap(t->segs[i]->base, t->segs[i]->size); close(t->segs[i]->fd); }
+    }
+    for (sub_t *s = subs; s; s = s->next)
+        fprintf(stderr, "[BROKER] assinatura %s: %llu entregues, %llu ACK, %llu reentregas, %zu pendentes, %zu em voo\n",
+            s->name, (unsigned long long) s->delivered, (unsigned long long) s->acked,
+            (unsigned long long) s->redelivered, s->qlen, s->flylen);
+    close(lfd); close(ep);
+    fprintf(stderr, "[BROKER] encerrado\n");
+    return 0;
+}
@@ -0,0 +1,239 @@
+// gcc broker_bench.c -o broker_bench -pthread
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * BENCHMARK DO BROKER LOCAL
+ * - Cria o tópico "bench" e uma assinatura exclusiva desta execução.
+ * - Uma thread consome (SUBSCRIBE) e confirma em lote cada frame DELIVER recebido.
+ * - A thread principal publica N mensagens de TAM bytes em lotes de LOTE,
+ *   mantendo até JANELA publicações sem resposta (pipeline).
+ * - Ao final mostra a vazão de publicação e a vazão ponta a ponta (publicação -> ACK).
+ * - Se o broker tiver log (DIR_LOG), relê as N mensagens com OP_FETCH (replay por offset).
+ *
+ * Uso:
+ *   ./broker_bench IP PORTA N TAM [LOTE] [JANELA]
+ *
+ * Exemplo:
+ *   ./broker_bench 127.0.0.1 7000 5000000 100 500 32
+ */
+
+enum { OP_CREATE_TOPIC = 1, OP_CREATE_SUB = 2, OP_PUBLISH = 3, OP_SUBSCRIBE = 4, OP_ACK = 5,
+       OP_FETCH = 9, OP_DELIVER = 0x40, OP_REPLY = 0x80, OP_ERR = 0xFF };
+
+typedef struct {
+    uint32_t op;   // big-endian
+    uint32_t len;  // big-endian
+} __attribute__((packed)) frame_hdr_t;
+
+static const char *g_ip;
+static int g_port;
+static char g_sub[64];
+static uint64_t g_total;
+
+static double now_s(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void wr_be(char *p, uint64_t v, int n) {
+    for (int i = n - 1; i >= 0; i--) { p[i] = (char) (v & 0xff); v >>= 8; }
+}
+static uint64_t rd_be(const char *p, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) v = (v << 8) | (unsigned char) p[i];
+    return v;
+}
+
+static int connect_tcp(const char *ip, int port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) { perror("socket"); return -1; }
+    struct sockaddr_in srv = { 0 };
+    srv.sin_family = AF_INET;
+    srv.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &srv.sin_addr) != 1) { fprintf(stderr, "IP inválido: %s\n", ip); close(s); return -1; }
+    if (connect(s, (struct sockaddr *) &srv, sizeof srv) < 0) { perror("connect"); close(s); return -1; }
+    int one = 1; setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    return s;
+}
+
+static ssize_t read_full(int fd, void *buf, size_t n) {
+    size_t got = 0; char *p = (char *) buf;
+    while (got < n) {
+        ssize_t r = recv(fd, p + got, n - got, 0);
+        if (r == 0) return 0;
+        if (r < 0) { if (errno == EINTR) continue; return -1; }
+        got += (size_t) r;
+    }
+    return (ssize_t) got;
+}
+
+static ssize_t write_full(int fd, const void *buf, size_t n) {
+    size_t sent = 0; const char *p = (const char *) buf;
+    while (sent < n) {
+        ssize_t r = send(fd, p + sent, n - sent, MSG_NOSIGNAL);
+        if (r <= 0) { if (r < 0 && errno == EINTR) continue; return -1; }
+        sent += (size_t) r;
+    }
+    return (ssize_t) sent;
+}
+
+// Lê um frame inteiro; *buf cresce conforme necessário. Retorna o op ou -1.
+static long read_frame(int fd, char **buf, size_t *cap, uint32_t *len) {
+    frame_hdr_t h;
+    if (read_full(fd, &h, sizeof h) <= 0) return -1;
+    *len = ntohl(h.len);
+    if (*len > *cap) { *cap = *len; *buf = (char *) realloc(*buf, *cap); }
+    if (*len && read_full(fd, *buf, *len) <= 0) return -1;
+    return (long) ntohl(h.op);
+}
+
+// Operação simples com resposta sem payload (CREATE_TOPIC / CREATE_SUB)
+static int call(int fd, uint32_t op, const char *payload, size_t len) {
+    char h[8]; wr_be(h, op, 4); wr_be(h + 4, len, 4);
+    if (write_full(fd, h, 8) < 0 || write_full(fd, payload, len) < 0) return -1;
+    char *buf = NULL; size_t cap = 0; uint32_t rlen;
+    long rop = read_frame(fd, &buf, &cap, &rlen);
+    if (rop == OP_ERR) fprintf(stderr, "erro do broker: %.*s\n", (int) rlen, buf);
+    free(buf);
+    return rop == (long) (op | OP_REPLY) ? 0 : -1;
+}
+
+static size_t put_name(char *p, const char *name) {
+    size_t n = strlen(name);
+    wr_be(p, n, 2); memcpy(p + 2, name, n);
+    return 2 + n;
+}
+
+// Thread consumidora: recebe DELIVER e confirma todos os ids do frame com um único ACK
+static void *consumer(void *p) {
+    double *t_end = (double *) p;
+    int s = connect_tcp(g_ip, g_port);
+    if (s < 0) return NULL;
+    char req[300]; size_t n = put_name(req, g_sub);
+    wr_be(req + n, 65536, 4); n += 4;
+    if (call(s, OP_SUBSCRIBE, req, n) < 0) { fprintf(stderr, "falha no SUBSCRIBE\n"); close(s); return NULL; }
+
+    char *buf = NULL, *ack = NULL; size_t cap = 0, ackcap = 0;
+    uint64_t got = 0;
+    while (got < g_total) {
+        uint32_t len;
+        long op = read_frame(s, &buf, &cap, &len);
+        if (op < 0) { fprintf(stderr, "consumidor: conexão perdida\n"); break; }
+        if (op != OP_DELIVER) continue;
+        uint32_t cnt = (uint32_t) rd_be(buf, 4);
+        size_t need = 12 + (size_t) cnt * 8;
+        if (need > ackcap) { ackcap = need; ack = (char *) realloc(ack, ackcap); }
+        wr_be(ack, OP_ACK, 4); wr_be(ack + 4, 4 + (size_t) cnt * 8, 4); wr_be(ack + 8, cnt, 4);
+        size_t off = 4;
+        for (uint32_t k = 0; k < cnt; k++) {
+            memcpy(ack + 12 + k * 8, buf + off, 8);  // id já está em big-endian
+            off += 24 + rd_be(buf + off + 20, 4);
+        }
+        if (write_full(s, ack, need) < 0) break;
+        got += cnt;
+    }
+    *t_end = now_s();
+    free(buf); free(ack); close(s);
+    return NULL;
+}
+
+// Relê `total` mensagens a partir de `first` com FETCH de até 1 MB; retorna os bytes lidos ou -1
+static long long replay(int s, uint64_t first, uint64_t total) {
+    char *buf = NULL; size_t cap = 0; uint32_t len;
+    char req[300]; size_t n0 = put_name(req, "bench");
+    uint64_t off = first;
+    long long bytes = 0;
+    while (off < first + total) {
+        size_t n = n0;
+        wr_be(req + n, off, 8); wr_be(req + n + 8, 1u << 20, 4); n += 12;
+        char h[8]; wr_be(h, OP_FETCH, 4); wr_be(h + 4, n, 4);
+        if (write_full(s, h, 8) < 0 || write_full(s, req, n) < 0) break;
+        long op = read_frame(s, &buf, &cap, &len);
+        if (op != (OP_FETCH | OP_REPLY) || len < 8) { bytes = -1; break; }
+        uint64_t next = rd_be(buf, 8);
+        if (next == off) break;  // nada novo
+        off = next; bytes += len - 8;
+    }
+    free(buf);
+    return bytes;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        fprintf(stderr, "uso: %s IP PORTA N TAM [LOTE] [JANELA]\n", argv[0]);
+        return 1;
+    }
+    g_ip = argv[1]; g_port = atoi(argv[2]);
+    g_total = strtoull(argv[3], NULL, 10);
+    size_t size = (size_t) atoi(argv[4]);
+    uint32_t batch = argc > 5 ? (uint32_t) atoi(argv[5]) : 500;
+    int window = argc > 6 ? atoi(argv[6]) : 32;
+    if (!g_total || !batch || window <= 0) { fprintf(stderr, "N, LOTE e JANELA devem ser > 0\n"); return 1; }
+    snprintf(g_sub, sizeof g_sub, "bench-%d", (int) getpid());
+
+    int s = connect_tcp(g_ip, g_port);
+    if (s < 0) return 1;
+    char req[600]; size_t n;
+    n = put_name(req, "bench");
+    if (call(s, OP_CREATE_TOPIC, req, n) < 0) return 1;
+    n = put_name(req, g_sub); n += put_name(req + n, "bench");
+    if (call(s, OP_CREATE_SUB, req, n) < 0) return 1;
+
+    double t_end = 0;
+    pthread_t th;
+    pthread_create(&th, NULL, consumer, &t_end);
+    usleep(100000);  // dá tempo do SUBSCRIBE chegar antes da primeira publicação
+
+    // Frame PUBLISH reaproveitado: só o último lote pode ter menos mensagens
+    size_t frame_len = 8 + 2 + 5 + 4 + (size_t) batch * (4 + size);
+    char *frame = (char *) malloc(frame_len);
+    size_t off = 8 + put_name(frame + 8, "bench");
+    size_t cnt_off = off; off += 4;
+    for (uint32_t k = 0; k < batch; k++) {
+        wr_be(frame + off, size, 4);
+        memset(frame + off + 4, 'a' + (int) (k % 26), size);
+        off += 4 + size;
+    }
+
+    char *rbuf = NULL; size_t rcap = 0; uint32_t rlen;
+    uint64_t sent = 0, first_id = 0; long inflight = 0;
+    double t0 = now_s();
+    while (sent < g_total) {
+        uint32_t cnt = (uint32_t) ((g_total - sent) < batch ? (g_total - sent) : batch);
+        size_t len = cnt_off + 4 + (size_t) cnt * (4 + size);
+        wr_be(frame, OP_PUBLISH, 4); wr_be(frame + 4, len - 8, 4); wr_be(frame + cnt_off, cnt, 4);
+        if (write_full(s, frame, len) < 0) { perror("send"); return 1; }
+        sent += cnt; inflight++;
+        while (inflight >= window || (sent == g_total && inflight > 0)) {  // janela cheia: espera respostas
+            if (read_frame(s, &rbuf, &rcap, &rlen) != (OP_PUBLISH | OP_REPLY)) { fprintf(stderr, "resposta inválida\n"); return 1; }
+            if (!first_id) first_id = rd_be(rbuf + 4, 8);
+            inflight--;
+        }
+    }
+    double t_pub = now_s() - t0;
+    pthread_join(th, NULL);
+    double t_e2e = t_end - t0;
+
+    printf("mensagens: %llu x %zu bytes (lote %u, janela %d)\n", (unsigned long long) g_total, size, batch, window);
+    printf("publicação:   %.3f s  %.0f msgs/s  %.1f MB/s\n", t_pub, g_total / t_pub, g_total * size / t_pub / 1e6);
+    printf("ponta a ponta: %.3f s  %.0f msgs/s\n", t_e2e, g_total / t_e2e);
+
+    double t1 = now_s();
+    long long bytes = replay(s, first_id, g_total);
+    double t_rep = now_s() - t1;
+    if (bytes > 0) printf("replay (FETCH): %.3f s  %.0f msgs/s  %.1f MB/s\n", t_rep, g_total / t_rep, bytes / t_rep / 1e6);
+    free(frame); free(rbuf); close(s);
+    return 0;
+}
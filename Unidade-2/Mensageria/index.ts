@@ -1,5 +1,6 @@
-import { PubSub, Message, Topic, Subscription } from '@google-cloud/pubsub';
+import { PubSub } from '@google-cloud/pubsub';
 import dotenv from 'dotenv';
+import { Attributes, LocalBroker, OutgoingMessage, PublishResult } from './localBroker';
 
 // Carrega as variáveis de ambiente do arquivo .env
 dotenv.config();
@@ -18,71 +19,274 @@ function getEnvVariable(key: string): string {
     return value;
 }
 
-// Configuração do cliente Pub/Sub
-const projectId = getEnvVariable('GOOGLE_CLOUD_PROJECT_ID');
+// Backend de mensageria: 'pubsub' (Google Cloud, padrão) ou 'local' (broker em C de ./broker)
+const backend = process.env.MENSAGERIA_BACKEND === 'local' ? 'local' : 'pubsub';
+
+// Configuração comum
 const topicName = getEnvVariable('TOPIC_NAME');
 const subscriptionName1 = getEnvVariable('SUBSCRIPTION_NAME_1');
 const subscriptionName2 = getEnvVariable('SUBSCRIPTION_NAME_2');
-const keyFilename = getEnvVariable('GOOGLE_APPLICATION_CREDENTIALS');
 
-// Inicializa o cliente Pub/Sub
-const pubSubClient = new PubSub({
-    projectId: projectId,
-    keyFilename: keyFilename,
-});
+// Inicializa o cliente Pub/Sub (credenciais só são exigidas no backend do Google)
+const pubSubClient =
+    backend === 'pubsub'
+        ? new PubSub({
+              projectId: getEnvVariable('GOOGLE_CLOUD_PROJECT_ID'),
+              keyFilename: getEnvVariable('GOOGLE_APPLICATION_CREDENTIALS'),
+          })
+        : null;
+
+// Inicializa o cliente do broker local (cria o tópico e as assinaturas do .env na primeira conexão)
+const localBroker =
+    backend === 'local'
+        ? new LocalBroker(process.env.BROKER_HOST || '127.0.0.1', Number(process.env.BROKER_PORT || 7000), {
+              topic: topicName,
+              subscriptions: [subscriptionName1, subscriptionName2],
+          })
+        : null;
+
+/*
+  Interfaces comuns aos dois backends (Topic/Subscription do Pub/Sub e do broker local)
+*/
+interface TopicLike {
+    // Publica um lote; devolve um resultado (ID ou erro) por mensagem, na mesma ordem
+    publishMessages(messages: OutgoingMessage[]): Promise<PublishResult[]>;
+}
+
+interface SubscriptionLike {
+    on(event: string, listener: (...args: any[]) => void): unknown;
+    removeAllListeners(): unknown;
+    // Só o broker local expõe pausa; no Pub/Sub o flowControl do cliente faz o papel
+    pause?(): void;
+    resume?(): void;
+}
+
+// Mensagem recebida (Message do Pub/Sub ou LocalMessage do broker local)
+interface ReceivedMessage {
+    id: string;
+    data: Buffer;
+    attributes: Attributes;
+    publishTime: Date;
+    length: number;
+    ack(): void;
+    nack(): void;
+}
+
+/*
+  Configurações de lote do Publisher
+*/
+interface BatchSettings {
+    maxMessages: number; // fecha o lote com esta quantidade de mensagens
+    maxBytes: number; // ... ou com este total de bytes
+    maxLatencyMs: number; // ... ou após este tempo desde a primeira mensagem do lote
+    maxInFlightBatches: number; // máximo de lotes enviados aguardando resposta e de lotes fechados na fila
+}
+
+const defaultBatchSettings: BatchSettings = {
+    maxMessages: 100,
+    maxBytes: 1024 * 1024,
+    maxLatencyMs: 10,
+    maxInFlightBatches: 8,
+};
+
+/*
+  Adapta o Topic do Pub/Sub à interface comum. O cliente do Google recebe as mesmas
+  configurações de lote e agrupa as publicações concorrentes em uma única requisição.
+*/
+function pubSubTopic(name: string, settings: BatchSettings): TopicLike {
+    const topic = pubSubClient!.topic(name, {
+        batching: {
+            maxMessages: settings.maxMessages,
+            maxBytes: settings.maxBytes,
+            maxMilliseconds: settings.maxLatencyMs,
+        },
+    });
+    return {
+        async publishMessages(messages: OutgoingMessage[]): Promise<PublishResult[]> {
+            const results = await Promise.allSettled(messages.map((m) => topic.publishMessage(m)));
+            return results.map((r) => (r.status === 'fulfilled' ? { messageId: r.value } : { error: r.reason as Error }));
+        },
+    };
+}
+
+/*
+  Configurações de controle de fluxo do Subscriber
+*/
+interface FlowSettings {
+    maxOutstandingMessages: number; // mensagens recebidas ainda sem ACK/NACK
+    maxOutstandingBytes: number; // ... ou total de bytes dessas mensagens
+    concurrency: number; // handlers executando ao mesmo tempo
+    ackBatchSize: number; // ACKs/NACKs agrupados por envio
+    ackFlushMs: number; // ... ou enviados após este tempo
+}
+
+const defaultFlowSettings: FlowSettings = {
+    maxOutstandingMessages: 1000,
+    maxOutstandingBytes: 100 * 1024 * 1024,
+    concurrency: 10,
+    ackBatchSize: 500,
+    ackFlushMs: 50,
+};
+
+// Métricas do Subscriber
+interface SubscriberMetrics {
+    received: number;
+    acked: number;
+    nacked: number;
+    outstanding: number; // sem ACK/NACK (na fila + em processamento)
+    outstandingBytes: number;
+    queued: number; // aguardando um handler livre
+    running: number; // handlers em execução
+    throughput: number; // ACKs no último segundo completo
+    lagMs: number; // idade (desde a publicação) da última mensagem recebida
+}
+
+type MessageHandler = (message: ReceivedMessage) => void | Promise<void>;
+
+// Mensagem aguardando o envio do seu lote
+type PendingMessage = { data: Buffer; resolve: (result: PublishResult) => void };
 
 /*
   Classe para gerenciar operações de Publisher (Produtor)
 */
 class Publisher {
-    private topic: Topic;
-
-    constructor(topicName: string) {
-        this.topic = pubSubClient.topic(topicName);
+    private topic: TopicLike;
+    private settings: BatchSettings;
+    private batch: PendingMessage[] = [];
+    private batchBytes = 0;
+    private timer?: ReturnType<typeof setTimeout>;
+    private queued: PendingMessage[][] = []; // lotes fechados aguardando vaga na janela
+    private blocked: Array<{ data: any; resolve: (result: PublishResult) => void }> = []; // aguardando vaga na fila
+    private inFlight = 0;
+    private idleWaiters: Array<() => void> = [];
+
+    constructor(topicName: string, settings: Partial<BatchSettings> = {}) {
+        this.settings = { ...defaultBatchSettings, ...settings };
+        this.topic = localBroker ? localBroker.topic(topicName) : pubSubTopic(topicName, this.settings);
     }
 
     /*
-     Publica uma mensagem no tópico
+     Enfileira uma mensagem no lote atual; resolve com o ID ou o erro desta mensagem.
+     Controle de fluxo: com maxInFlightBatches lotes fechados já na fila, a mensagem espera
+     vaga (na ordem de chegada e ainda sem serializar) em vez de acumular lotes na memória
     */
-    async publishMessage(data: any): Promise<string> {
+    publish(data: any): Promise<PublishResult> {
+        return new Promise((resolve) => {
+            this.blocked.push({ data, resolve });
+            this.pump();
+        });
+    }
+
+    // Acrescenta uma mensagem ao lote atual; fecha o lote se encheu
+    private append(data: any, resolve: (result: PublishResult) => void): void {
+        let buffer: Buffer;
         try {
-            const dataBuffer = Buffer.from(JSON.stringify(data));
-
-            // Adiciona atributos à mensagem
-            const messageId = await this.topic.publishMessage({
-                data: dataBuffer,
-                attributes: {
-                    timestamp: new Date().toISOString(),
-                    origin: 'node-publisher',
-                },
-            });
-
-            console.log(`✅ Mensagem publicada com ID: ${messageId}`);
-            return messageId;
+            buffer = Buffer.from(JSON.stringify(data)); // serializa uma única vez
         } catch (error) {
-            console.error('❌ Erro ao publicar mensagem:', error);
-            throw error;
+            resolve({ error: error as Error });
+            return;
+        }
+        this.batch.push({ data: buffer, resolve });
+        this.batchBytes += buffer.length;
+        if (this.batch.length >= this.settings.maxMessages || this.batchBytes >= this.settings.maxBytes) {
+            this.queueBatch();
+        } else if (!this.timer) {
+            this.timer = setTimeout(() => this.closeBatch(), this.settings.maxLatencyMs);
+        }
+    }
+
+    // Move o lote atual para a fila de lotes fechados
+    private queueBatch(): void {
+        if (this.timer) {
+            clearTimeout(this.timer);
+            this.timer = undefined;
+        }
+        if (this.batch.length) {
+            this.queued.push(this.batch);
+            this.batch = [];
+            this.batchBytes = 0;
         }
     }
 
     /*
-     Publica múltiplas mensagens em lote
+     Fecha o lote atual e envia o que couber na janela de lotes em voo
     */
-    async publishBatch(messages: any[]): Promise<string[]> {
-        try {
-            const messageIds: string[] = [];
+    private closeBatch(): void {
+        this.queueBatch();
+        this.pump();
+    }
 
-            for (const message of messages) {
-                const messageId = await this.publishMessage(message);
-                messageIds.push(messageId);
+    private pump(): void {
+        for (;;) {
+            while (this.inFlight < this.settings.maxInFlightBatches && this.queued.length) {
+                const batch = this.queued.shift()!;
+                this.inFlight++;
+                this.sendBatch(batch).finally(() => {
+                    this.inFlight--;
+                    this.pump();
+                });
             }
+            // Mensagens bloqueadas entram no lote atual enquanto a fila de lotes fechados tiver vaga
+            if (!this.blocked.length || this.queued.length >= this.settings.maxInFlightBatches) break;
+            const { data, resolve } = this.blocked.shift()!;
+            this.append(data, resolve);
+        }
+        if (!this.inFlight && !this.queued.length && !this.batch.length && !this.blocked.length) {
+            const waiters = this.idleWaiters;
+            this.idleWaiters = [];
+            waiters.forEach((resolve) => resolve());
+        }
+    }
 
-            console.log(`✅ ${messageIds.length} mensagens publicadas com sucesso!`);
-            return messageIds;
+    private async sendBatch(batch: PendingMessage[]): Promise<void> {
+        // Atributos (e timestamp) calculados uma vez por lote
+        const attributes = { timestamp: new Date().toISOString(), origin: 'node-publisher' };
+        let results: PublishResult[];
+        try {
+            results = await this.topic.publishMessages(batch.map((m) => ({ data: m.data, attributes })));
         } catch (error) {
-            console.error('❌ Erro ao publicar lote de mensagens:', error);
-            throw error;
+            results = batch.map(() => ({ error: error as Error }));
         }
+        batch.forEach((m, i) => m.resolve(results[i] ?? { error: new Error('publicação sem resultado') }));
+    }
+
+    /*
+     Envia o lote parcial e aguarda até não haver publicações pendentes
+    */
+    flush(): Promise<void> {
+        const idle = new Promise<void>((resolve) => this.idleWaiters.push(resolve));
+        this.closeBatch();
+        return idle;
+    }
+
+    /*
+     Publica uma mensagem no tópico
+    */
+    async publishMessage(data: any): Promise<string> {
+        const { messageId, error } = await this.publish(data);
+        if (!messageId) {
+            console.error('❌ Erro ao publicar mensagem:', error);
+            throw error ?? new Error('publicação sem ID');
+        }
+        console.log(`✅ Mensagem publicada com ID: ${messageId}`);
+        return messageId;
+    }
+
+    /*
+     Publica múltiplas mensagens em lote; devolve o ID ou o erro de cada mensagem
+    */
+    async publishBatch(messages: any[]): Promise<PublishResult[]> {
+        const pending = messages.map((message) => this.publish(message));
+        this.closeBatch(); // não espera a janela de latência para o último lote
+        const results = await Promise.all(pending);
+
+        const failures = results.filter((r) => r.error).length;
+        if (failures) {
+            console.error(`❌ ${failures} de ${results.length} mensagens falharam`);
+        } else {
+            console.log(`✅ ${results.length} mensagens publicadas com sucesso!`);
+        }
+        return results;
     }
 }
 
@@ -90,36 +294,162 @@ class Publisher {
  Classe para gerenciar operações de Subscriber (Consumidor)
 */
 class Subscriber {
-    private subscription: Subscription;
+    private subscription: SubscriptionLike;
     private subscriptionName: string;
-
-    constructor(subscriptionName: string) {
+    private settings: FlowSettings;
+    private handler: MessageHandler = this.defaultMessageHandler.bind(this);
+    private queue: ReceivedMessage[] = [];
+    private running = 0;
+    private outstanding = 0;
+    private outstandingBytes = 0;
+    private paused = false;
+    private received = 0;
+    private acked = 0;
+    private nacked = 0;
+    private lagMs = 0;
+    private ackSecond = 0; // segundo (epoch) da janela de vazão atual
+    private acksThisSecond = 0;
+    private acksLastSecond = 0;
+
+    constructor(subscriptionName: string, settings: Partial<FlowSettings> = {}) {
         this.subscriptionName = subscriptionName;
-        this.subscription = pubSubClient.subscription(subscriptionName);
+        this.settings = { ...defaultFlowSettings, ...settings };
+        const s = this.settings;
+        this.subscription = localBroker
+            ? localBroker.subscription(subscriptionName, {
+                  maxOutstanding: s.maxOutstandingMessages,
+                  ackBatchSize: s.ackBatchSize,
+                  ackFlushMs: s.ackFlushMs,
+              })
+            : pubSubClient!.subscription(subscriptionName, {
+                  flowControl: { maxMessages: s.maxOutstandingMessages, maxBytes: s.maxOutstandingBytes },
+                  batching: { maxMessages: s.ackBatchSize, maxMilliseconds: s.ackFlushMs },
+              });
     }
 
     /*
      Inicia a escuta de mensagens (Pull Mode)
     */
-    startListening(messageHandler?: (message: Message) => void): void {
+    startListening(messageHandler?: MessageHandler): void {
         console.log(`🎧 Aguardando mensagens na assinatura: ${this.subscriptionName}...`);
 
         // Handler padrão ou customizado
-        const handleMessage = messageHandler || this.defaultMessageHandler.bind(this);
+        if (messageHandler) this.handler = messageHandler;
 
-        // Event listener para mensagens
-        this.subscription.on('message', handleMessage);
+        // Event listener para mensagens: enfileira e despacha com concorrência limitada
+        this.subscription.on('message', (message: ReceivedMessage) => this.enqueue(message));
 
         // Event listener para erros
-        this.subscription.on('error', (error) => {
+        this.subscription.on('error', (error: Error) => {
             console.error(`❌ Erro na assinatura ${this.subscriptionName}:`, error);
         });
     }
 
+    private enqueue(message: ReceivedMessage): void {
+        this.received++;
+        this.outstanding++;
+        this.outstandingBytes += message.length;
+        this.lagMs = Math.max(0, Date.now() - message.publishTime.getTime());
+        this.queue.push(message);
+        this.updateFlow();
+        this.dispatch();
+    }
+
+    private dispatch(): void {
+        while (this.running < this.settings.concurrency && this.queue.length) {
+            this.run(this.queue.shift()!);
+        }
+    }
+
+    /*
+     Executa o handler; ACK/NACK liberam o crédito uma única vez e exceções viram NACK
+    */
+    private async run(message: ReceivedMessage): Promise<void> {
+        let settled = false;
+        const settle = (ok: boolean) => {
+            if (settled) return;
+            settled = true;
+            this.outstanding--;
+            this.outstandingBytes -= message.length;
+            if (ok) {
+                message.ack();
+                this.countAck();
+            } else {
+                message.nack();
+                this.nacked++;
+            }
+            this.updateFlow();
+        };
+        const wrapped: ReceivedMessage = Object.create(message, {
+            ack: { value: () => settle(true) },
+            nack: { value: () => settle(false) },
+        });
+
+        this.running++;
+        try {
+            await this.handler(wrapped);
+        } catch (error) {
+            console.error(`❌ Handler falhou na assinatura ${this.subscriptionName}:`, error);
+            settle(false);
+        } finally {
+            this.running--;
+            this.dispatch();
+        }
+    }
+
+    private countAck(): void {
+        this.acked++;
+        const second = Math.floor(Date.now() / 1000);
+        if (second !== this.ackSecond) {
+            this.acksLastSecond = second === this.ackSecond + 1 ? this.acksThisSecond : 0;
+            this.acksThisSecond = 0;
+            this.ackSecond = second;
+        }
+        this.acksThisSecond++;
+    }
+
+    /*
+     Pausa a entrega acima dos limites e retoma quando cair abaixo da metade
+    */
+    private updateFlow(): void {
+        const s = this.settings;
+        if (!this.paused && (this.outstanding >= s.maxOutstandingMessages || this.outstandingBytes >= s.maxOutstandingBytes)) {
+            this.paused = true;
+            this.subscription.pause?.();
+        } else if (
+            this.paused &&
+            this.outstanding <= s.maxOutstandingMessages / 2 &&
+            this.outstandingBytes <= s.maxOutstandingBytes / 2
+        ) {
+            this.paused = false;
+            this.subscription.resume?.();
+        }
+    }
+
+    /*
+     Retorna as métricas atuais do Subscriber
+    */
+    getMetrics(): SubscriberMetrics {
+        const second = Math.floor(Date.now() / 1000);
+        const throughput =
+            second === this.ackSecond ? this.acksLastSecond : second === this.ackSecond + 1 ? this.acksThisSecond : 0;
+        return {
+            received: this.received,
+            acked: this.acked,
+            nacked: this.nacked,
+            outstanding: this.outstanding,
+            outstandingBytes: this.outstandingBytes,
+            queued: this.queue.length,
+            running: this.running,
+            throughput,
+            lagMs: this.lagMs,
+        };
+    }
+
     /*
      Handler padrão para processar mensagens
     */
-    private defaultMessageHandler(message: Message): void {
+    private defaultMessageHandler(message: ReceivedMessage): void {
         try {
             console.log(`\n📨 Nova mensagem recebida na assinatura: ${this.subscriptionName}`);
             console.log(`   ID da mensagem: ${message.id}`);
@@ -210,7 +540,9 @@ class PubSubManager {
     */
     async checkTopic(): Promise<boolean> {
         try {
-            const [exists] = await pubSubClient.topic(topicName).exists();
+            const [exists] = localBroker
+                ? await localBroker.topic(topicName).exists()
+                : await pubSubClient!.topic(topicName).exists();
             console.log(`Tópico '${topicName}': ${exists ? '✅ Existe' : '❌ Não existe'}`);
             return exists;
         } catch (error) {
@@ -224,7 +556,9 @@ class PubSubManager {
     */
     async checkSubscription(subscriptionName: string): Promise<boolean> {
         try {
-            const [exists] = await pubSubClient.subscription(subscriptionName).exists();
+            const [exists] = localBroker
+                ? await localBroker.subscription(subscriptionName).exists()
+                : await pubSubClient!.subscription(subscriptionName).exists();
             console.log(`Assinatura '${subscriptionName}': ${exists ? '✅ Existe' : '❌ Não existe'}`);
             return exists;
         } catch (error) {
@@ -238,9 +572,11 @@ class PubSubManager {
     */
     async listTopics(): Promise<void> {
         try {
-            const [topics] = await pubSubClient.getTopics();
+            const names = localBroker
+                ? await localBroker.list(0)
+                : (await pubSubClient!.getTopics())[0].map((topic) => topic.name);
             console.log('\n📋 Tópicos disponíveis:');
-            topics.forEach((topic) => console.log(`   - ${topic.name}`));
+            names.forEach((name) => console.log(`   - ${name}`));
         } catch (error) {
             console.error('Erro ao listar tópicos:', error);
         }
@@ -251,7 +587,9 @@ class PubSubManager {
     */
     async listSubscriptions(): Promise<void> {
         try {
-            const [subscriptions] = await pubSubClient.topic(topicName).getSubscriptions();
+            const [subscriptions] = localBroker
+                ? await localBroker.topic(topicName).getSubscriptions()
+                : await pubSubClient!.topic(topicName).getSubscriptions();
             console.log(`\n📋 Assinaturas do tópico '${topicName}':`);
             subscriptions.forEach((sub) => console.log(`   - ${sub.name}`));
         } catch (error) {
@@ -264,7 +602,7 @@ class PubSubManager {
  Função de demonstração
 */
 async function demo() {
-    console.log('🚀 Iniciando demonstração do Google Cloud Pub/Sub\n');
+    console.log(`🚀 Iniciando demonstração de mensageria (backend: ${backend})\n`);
     console.log('='.repeat(60));
 
     const manager = new PubSubManager();
@@ -340,7 +678,17 @@ async function demo() {
 }
 
 // Exporta as classes e funções
-export { PubSubManager, Publisher, Subscriber, demo };
+export {
+    PubSubManager,
+    Publisher,
+    Subscriber,
+    ReceivedMessage,
+    BatchSettings,
+    FlowSettings,
+    SubscriberMetrics,
+    PublishResult,
+    demo,
+};
 
 // Executa a demonstração se for o arquivo principal
 if (require.main === module) {
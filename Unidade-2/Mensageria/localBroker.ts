@@ -0,0 +1,511 @@
+import { EventEmitter } from 'events';
+import net from 'net';
+
+/*
+  Cliente do broker local em C (broker/broker.c)
+
+  Expõe classes com a mesma forma usada de Topic/Subscription do Google Cloud Pub/Sub,
+  para que Publisher e Subscriber (index.ts) funcionem com MENSAGERIA_BACKEND=local.
+
+  Protocolo: frames [u32 op][u32 len][payload] em big-endian (ver cabeçalho de broker.c).
+  O corpo de cada mensagem é opaco para o broker; aqui ele carrega atributos + dados:
+    [u16 qtd_atributos] qtd x ([u16 n][chave][u16 n][valor]) [dados]
+*/
+
+export const OP = {
+    CREATE_TOPIC: 1,
+    CREATE_SUB: 2,
+    PUBLISH: 3,
+    SUBSCRIBE: 4,
+    ACK: 5,
+    NACK: 6,
+    EXISTS: 7,
+    LIST: 8,
+    FETCH: 9,
+    DELIVER: 0x40,
+    REPLY: 0x80,
+    ERR: 0xff,
+} as const;
+
+export type Attributes = { [key: string]: string };
+
+// Mensagem a publicar e resultado individual de uma publicação em lote
+export type OutgoingMessage = { data: Buffer; attributes?: Attributes };
+export type PublishResult = { messageId?: string; error?: Error };
+
+/*
+  Codifica os atributos (prefixo do corpo da mensagem)
+*/
+export function encodeAttributes(attributes: Attributes = {}): Buffer {
+    const entries = Object.entries(attributes);
+    const parts: Buffer[] = [];
+    const count = Buffer.alloc(2);
+    count.writeUInt16BE(entries.length);
+    parts.push(count);
+    for (const [key, value] of entries) {
+        for (const text of [key, value]) {
+            const bytes = Buffer.from(text);
+            const len = Buffer.alloc(2);
+            len.writeUInt16BE(bytes.length);
+            parts.push(len, bytes);
+        }
+    }
+    return Buffer.concat(parts);
+}
+
+/*
+  Codifica atributos + dados no corpo da mensagem
+*/
+export function encodeBody(data: Buffer, attributes: Attributes = {}): Buffer {
+    return Buffer.concat([encodeAttributes(attributes), data]);
+}
+
+/*
+  Decodifica o corpo gerado por encodeBody
+*/
+export function decodeBody(body: Buffer): { data: Buffer; attributes: Attributes } {
+    const attributes: Attributes = {};
+    let off = 2;
+    const count = body.readUInt16BE(0);
+    for (let i = 0; i < count; i++) {
+        const klen = body.readUInt16BE(off);
+        const key = body.toString('utf8', off + 2, off + 2 + klen);
+        off += 2 + klen;
+        const vlen = body.readUInt16BE(off);
+        attributes[key] = body.toString('utf8', off + 2, off + 2 + vlen);
+        off += 2 + vlen;
+    }
+    return { data: body.subarray(off), attributes };
+}
+
+function encodeName(name: string): Buffer {
+    const bytes = Buffer.from(name);
+    const len = Buffer.alloc(2);
+    len.writeUInt16BE(bytes.length);
+    return Buffer.concat([len, bytes]);
+}
+
+function encodeIds(ids: bigint[]): Buffer {
+    const buf = Buffer.alloc(4 + ids.length * 8);
+    buf.writeUInt32BE(ids.length, 0);
+    ids.forEach((id, i) => buf.writeBigUInt64BE(id, 4 + i * 8));
+    return buf;
+}
+
+/*
+  Conexão TCP com o broker: monta/desmonta frames e casa respostas com requisições (FIFO)
+*/
+class FrameConnection extends EventEmitter {
+    private socket: net.Socket;
+    private buffer: Buffer = Buffer.alloc(0);
+    private pending: Array<{ op: number; resolve: (payload: Buffer) => void; reject: (error: Error) => void }> = [];
+    readonly ready: Promise<void>;
+
+    constructor(host: string, port: number) {
+        super();
+        this.socket = net.createConnection({ host, port });
+        this.socket.setNoDelay(true);
+        this.ready = new Promise((resolve, reject) => {
+            this.socket.once('connect', () => resolve());
+            this.socket.once('error', reject);
+        });
+        this.socket.on('data', (chunk: Buffer) => this.onData(chunk));
+        this.socket.on('error', (error) => this.failAll(error));
+        this.socket.on('close', () => {
+            this.failAll(new Error('conexão com o broker encerrada'));
+            this.emit('close');
+        });
+    }
+
+    private onData(chunk: Buffer): void {
+        this.buffer = this.buffer.length ? Buffer.concat([this.buffer, chunk]) : chunk;
+        let off = 0;
+        while (this.buffer.length - off >= 8) {
+            const op = this.buffer.readUInt32BE(off);
+            const len = this.buffer.readUInt32BE(off + 4);
+            if (this.buffer.length - off < 8 + len) break;
+            const payload = this.buffer.subarray(off + 8, off + 8 + len);
+            off += 8 + len;
+
+            if (op === OP.DELIVER) {
+                this.emit('deliver', payload);
+                continue;
+            }
+            // Respostas chegam na ordem das requisições
+            const waiter = this.pending.shift();
+            if (!waiter) continue;
+            if (op === OP.ERR) waiter.reject(new Error(`broker: ${payload.toString()}`));
+            else if (op !== (waiter.op | OP.REPLY)) waiter.reject(new Error(`resposta inesperada (op=${op})`));
+            else waiter.resolve(payload);
+        }
+        this.buffer = off === this.buffer.length ? Buffer.alloc(0) : this.buffer.subarray(off);
+    }
+
+    private failAll(error: Error): void {
+        const waiters = this.pending;
+        this.pending = [];
+        waiters.forEach((w) => w.reject(error));
+    }
+
+    private write(op: number, payload: Buffer): void {
+        const header = Buffer.alloc(8);
+        header.writeUInt32BE(op, 0);
+        header.writeUInt32BE(payload.length, 4);
+        this.socket.write(Buffer.concat([header, payload]));
+    }
+
+    /*
+     Envia uma requisição e aguarda a resposta correspondente
+    */
+    request(op: number, payload: Buffer): Promise<Buffer> {
+        return new Promise((resolve, reject) => {
+            this.pending.push({ op, resolve, reject });
+            this.write(op, payload);
+        });
+    }
+
+    /*
+     Envia um frame sem resposta (ACK/NACK)
+    */
+    send(op: number, payload: Buffer): void {
+        this.write(op, payload);
+    }
+
+    /*
+     Para/retoma a leitura do socket (o TCP propaga a contrapressão até o broker)
+    */
+    pause(): void {
+        this.socket.pause();
+    }
+
+    resume(): void {
+        this.socket.resume();
+    }
+
+    close(): void {
+        this.socket.end();
+    }
+}
+
+/*
+  Mensagem recebida do broker local (mesma forma de Message do Pub/Sub)
+*/
+export class LocalMessage {
+    readonly id: string;
+    readonly data: Buffer;
+    readonly attributes: Attributes;
+    readonly publishTime: Date;
+    readonly deliveryAttempt: number;
+    private readonly rawId: bigint;
+    private readonly subscription?: LocalSubscription; // ausente em mensagens de replay (ack/nack sem efeito)
+
+    constructor(subscription: LocalSubscription | undefined, id: bigint, publishMs: number, attempt: number, body: Buffer) {
+        const { data, attributes } = decodeBody(body);
+        this.subscription = subscription;
+        this.rawId = id;
+        this.id = id.toString();
+        this.data = data;
+        this.attributes = attributes;
+        this.publishTime = new Date(publishMs);
+        this.deliveryAttempt = attempt;
+    }
+
+    get length(): number {
+        return this.data.length;
+    }
+
+    ack(): void {
+        this.subscription?.ackIds([this.rawId]);
+    }
+
+    nack(): void {
+        this.subscription?.nackIds([this.rawId]);
+    }
+}
+
+/*
+  Tópico no broker local
+*/
+export class LocalTopic {
+    constructor(private broker: LocalBroker, readonly name: string) {}
+
+    async publishMessage(message: { data: Buffer; attributes?: Attributes }): Promise<string> {
+        const [id] = await this.publishBodies([encodeBody(message.data, message.attributes)]);
+        return id;
+    }
+
+    /*
+     Publica um lote em um único frame PUBLISH; falha do frame vale para todas as mensagens.
+     Se o broker confirmar só as primeiras (falha de gravação no meio), as demais recebem erro
+    */
+    async publishMessages(messages: OutgoingMessage[]): Promise<PublishResult[]> {
+        // Mensagens do mesmo lote costumam compartilhar o objeto de atributos: codifica uma vez só
+        const empty = encodeAttributes();
+        let lastAttributes: Attributes | undefined;
+        let prefix = empty;
+        const bodies = messages.map((m) => {
+            if (m.attributes && m.attributes !== lastAttributes) {
+                lastAttributes = m.attributes;
+                prefix = encodeAttributes(m.attributes);
+            }
+            return [m.attributes ? prefix : empty, m.data];
+        });
+        try {
+            const ids = await this.publishBodies(bodies);
+            // Resposta parcial: o broker gravou só as primeiras; as demais voltam com erro para reenvio
+            const notSaved = new Error('publish: mensagem não gravada pelo broker (lote parcial)');
+            return messages.map((_, i) => (i < ids.length ? { messageId: ids[i] } : { error: notSaved }));
+        } catch (error) {
+            return messages.map(() => ({ error: error as Error }));
+        }
+    }
+
+    /*
+     Publica vários corpos (cada um em uma ou mais partes) em um único frame; retorna os IDs na ordem
+    */
+    async publishBodies(bodies: Array<Buffer | Buffer[]>): Promise<string[]> {
+        const header = Buffer.alloc(4);
+        header.writeUInt32BE(bodies.length);
+        const parts: Buffer[] = [encodeName(this.name), header];
+        for (const body of bodies) {
+            const pieces = Array.isArray(body) ? body : [body];
+            const len = Buffer.alloc(4);
+            len.writeUInt32BE(pieces.reduce((n, b) => n + b.length, 0));
+            parts.push(len, ...pieces);
+        }
+        const conn = await this.broker.connection();
+        const reply = await conn.request(OP.PUBLISH, Buffer.concat(parts));
+        const count = reply.readUInt32BE(0);
+        const first = reply.readBigUInt64BE(4);
+        return Array.from({ length: count }, (_, i) => (first + BigInt(i)).toString());
+    }
+
+    /*
+     Relê o log do tópico a partir de um offset (= ID da mensagem) até o fim atual.
+     Exige o broker iniciado com DIR_LOG; usa uma conexão própria para não atrasar publicações.
+    */
+    async *replay(fromOffset: bigint = 1n, maxBytes = 1024 * 1024): AsyncGenerator<LocalMessage> {
+        const conn = new FrameConnection(this.broker.host, this.broker.port);
+        try {
+            await conn.ready;
+            let offset = fromOffset;
+            for (;;) {
+                const req = Buffer.alloc(12);
+                req.writeBigUInt64BE(offset, 0);
+                req.writeUInt32BE(maxBytes, 8);
+                const reply = await conn.request(OP.FETCH, Buffer.concat([encodeName(this.name), req]));
+                const next = reply.readBigUInt64BE(0);
+                if (next === offset) return; // alcançou o fim do log
+                // Registros: [u32 tam_total][u32 soma][u64 offset][u64 publish_ms][corpo]
+                for (let off = 8; off < reply.length; ) {
+                    const size = reply.readUInt32BE(off);
+                    const id = reply.readBigUInt64BE(off + 8);
+                    const publishMs = Number(reply.readBigUInt64BE(off + 16));
+                    yield new LocalMessage(undefined, id, publishMs, 1, reply.subarray(off + 24, off + size));
+                    off += size;
+                }
+                offset = next;
+            }
+        } finally {
+            conn.close();
+        }
+    }
+
+    async exists(): Promise<[boolean]> {
+        return [await this.broker.exists(0, this.name)];
+    }
+
+    async getSubscriptions(): Promise<[Array<{ name: string }>]> {
+        const names = await this.broker.list(1, this.name);
+        return [names.map((name) => ({ name }))];
+    }
+}
+
+// Opções de uma assinatura local
+export type LocalSubscriptionOptions = {
+    maxOutstanding?: number; // crédito no broker: mensagens entregues ainda sem ACK/NACK
+    ackBatchSize?: number; // ACKs/NACKs acumulados antes de enviar um frame
+    ackFlushMs?: number; // ... ou após este tempo
+};
+
+/*
+  Assinatura no broker local: abre uma conexão própria ao registrar o listener 'message'.
+  ACKs e NACKs são agrupados e enviados por tamanho ou tempo.
+*/
+export class LocalSubscription extends EventEmitter {
+    private conn?: FrameConnection;
+    private maxOutstanding: number;
+    private ackBatchSize: number;
+    private ackFlushMs: number;
+    private pendingAcks: bigint[] = [];
+    private pendingNacks: bigint[] = [];
+    private ackTimer?: ReturnType<typeof setTimeout>;
+
+    constructor(private broker: LocalBroker, readonly name: string, options: LocalSubscriptionOptions = {}) {
+        super();
+        this.maxOutstanding = options.maxOutstanding ?? 1000;
+        // O lote de ACK não pode segurar todo o crédito, senão o broker para de entregar até o timer
+        this.ackBatchSize = Math.min(options.ackBatchSize ?? 500, Math.max(1, Math.floor(this.maxOutstanding / 2)));
+        this.ackFlushMs = options.ackFlushMs ?? 50;
+    }
+
+    /*
+     Como no Pub/Sub: registrar o primeiro listener 'message' inicia o recebimento
+    */
+    on(event: string | symbol, listener: (...args: any[]) => void): this {
+        super.on(event, listener);
+        if (event === 'message' && !this.conn) this.open();
+        return this;
+    }
+
+    removeAllListeners(event?: string | symbol): this {
+        super.removeAllListeners(event);
+        if (this.listenerCount('message') === 0) this.close();
+        return this;
+    }
+
+    private open(): void {
+        const conn = new FrameConnection(this.broker.host, this.broker.port);
+        this.conn = conn;
+        conn.on('deliver', (payload: Buffer) => this.onDeliver(payload));
+        conn.on('close', () => {
+            if (this.conn === conn) this.conn = undefined;
+        });
+        const subscribe = async () => {
+            await this.broker.connection(); // garante tópico/assinaturas criados
+            await conn.ready;
+            const max = Buffer.alloc(4);
+            max.writeUInt32BE(this.maxOutstanding);
+            await conn.request(OP.SUBSCRIBE, Buffer.concat([encodeName(this.name), max]));
+        };
+        subscribe().catch((error) => this.emit('error', error));
+    }
+
+    private onDeliver(payload: Buffer): void {
+        const count = payload.readUInt32BE(0);
+        let off = 4;
+        for (let i = 0; i < count; i++) {
+            const id = payload.readBigUInt64BE(off);
+            const publishMs = Number(payload.readBigUInt64BE(off + 8));
+            const attempt = payload.readUInt32BE(off + 16);
+            const len = payload.readUInt32BE(off + 20);
+            const body = payload.subarray(off + 24, off + 24 + len);
+            off += 24 + len;
+            this.emit('message', new LocalMessage(this, id, publishMs, attempt, body));
+        }
+    }
+
+    ackIds(ids: bigint[]): void {
+        this.pendingAcks.push(...ids);
+        this.scheduleFlush();
+    }
+
+    nackIds(ids: bigint[]): void {
+        this.pendingNacks.push(...ids);
+        this.scheduleFlush();
+    }
+
+    private scheduleFlush(): void {
+        if (this.pendingAcks.length + this.pendingNacks.length >= this.ackBatchSize) this.flushAcks();
+        else if (!this.ackTimer) this.ackTimer = setTimeout(() => this.flushAcks(), this.ackFlushMs);
+    }
+
+    /*
+     Envia os ACKs/NACKs acumulados (um frame de cada tipo)
+    */
+    flushAcks(): void {
+        if (this.ackTimer) {
+            clearTimeout(this.ackTimer);
+            this.ackTimer = undefined;
+        }
+        if (this.pendingAcks.length) this.conn?.send(OP.ACK, encodeIds(this.pendingAcks));
+        if (this.pendingNacks.length) this.conn?.send(OP.NACK, encodeIds(this.pendingNacks));
+        this.pendingAcks = [];
+        this.pendingNacks = [];
+    }
+
+    pause(): void {
+        this.conn?.pause();
+    }
+
+    resume(): void {
+        this.conn?.resume();
+    }
+
+    async exists(): Promise<[boolean]> {
+        return [await this.broker.exists(1, this.name)];
+    }
+
+    close(): void {
+        this.flushAcks();
+        this.conn?.close();
+        this.conn = undefined;
+    }
+}
+
+/*
+  Cliente do broker: conexão de controle/publicação e fábrica de tópicos e assinaturas
+*/
+export class LocalBroker {
+    private control?: Promise<FrameConnection>;
+
+    constructor(
+        readonly host: string,
+        readonly port: number,
+        private setup?: { topic: string; subscriptions: string[] },
+    ) {}
+
+    /*
+     Conexão de controle (criada na primeira chamada); garante o tópico e as assinaturas do .env
+    */
+    connection(): Promise<FrameConnection> {
+        if (!this.control) {
+            this.control = (async () => {
+                const conn = new FrameConnection(this.host, this.port);
+                await conn.ready;
+                if (this.setup) {
+                    await conn.request(OP.CREATE_TOPIC, encodeName(this.setup.topic));
+                    for (const sub of this.setup.subscriptions) {
+                        await conn.request(OP.CREATE_SUB, Buffer.concat([encodeName(sub), encodeName(this.setup.topic)]));
+                    }
+                }
+                conn.on('close', () => (this.control = undefined));
+                return conn;
+            })();
+            this.control.catch(() => (this.control = undefined));
+        }
+        return this.control;
+    }
+
+    topic(name: string): LocalTopic {
+        return new LocalTopic(this, name);
+    }
+
+    subscription(name: string, options?: LocalSubscriptionOptions): LocalSubscription {
+        return new LocalSubscription(this, name, options);
+    }
+
+    async exists(kind: 0 | 1, name: string): Promise<boolean> {
+        const conn = await this.connection();
+        const reply = await conn.request(OP.EXISTS, Buffer.concat([Buffer.from([kind]), encodeName(name)]));
+        return reply.readUInt8(0) === 1;
+    }
+
+    async list(kind: 0 | 1, topic = ''): Promise<string[]> {
+        const conn = await this.connection();
+        const payload = kind === 0 ? Buffer.from([0]) : Buffer.concat([Buffer.from([1]), encodeName(topic)]);
+        const reply = await conn.request(OP.LIST, payload);
+        const names: string[] = [];
+        let off = 4;
+        for (let i = 0; i < reply.readUInt32BE(0); i++) {
+            const len = reply.readUInt16BE(off);
+            names.push(reply.toString('utf8', off + 2, off + 2 + len));
+            off += 2 + len;
+        }
+        return names;
+    }
+
+    async close(): Promise<void> {
+        if (this.control) (await this.control).close();
+    }
+}
@@ -46,9 +46,13 @@ async function runPublisher() {
             { tipo: 'log', level: 'warning', mensagem: 'Uso de memória elevado' },
         ];
 
-        await publisher.publishBatch(mensagens);
+        const resultados = await publisher.publishBatch(mensagens);
 
-        console.log('\n✅ Todas as mensagens foram publicadas com sucesso!');
+        if (resultados.some((r) => r.error)) {
+            console.error('\n❌ Algumas mensagens não foram publicadas');
+        } else {
+            console.log('\n✅ Todas as mensagens foram publicadas com sucesso!');
+        }
     } catch (error) {
         console.error('❌ Erro ao publicar mensagens:', error);
     }
@@ -0,0 +1,36 @@
+import dotenv from 'dotenv';
+import { LocalBroker } from './localBroker';
+
+dotenv.config();
+
+/*
+ Relê o log durável do tópico no broker local a partir de um offset (ID da mensagem)
+
+ Uso:
+   npm run replay -- [offset]
+ Requer o broker iniciado com DIR_LOG (npm run broker:log)
+*/
+async function runReplay() {
+    const topicName = process.env.TOPIC_NAME || 'sistemas-distribuidos';
+    const from = BigInt(process.argv[2] || '1');
+    const broker = new LocalBroker(process.env.BROKER_HOST || '127.0.0.1', Number(process.env.BROKER_PORT || 7000));
+
+    console.log(`⏪ Relendo ${topicName} a partir do offset ${from}...\n`);
+    const start = Date.now();
+    let count = 0;
+    let bytes = 0;
+    for await (const message of broker.topic(topicName).replay(from)) {
+        if (count < 5) {
+            console.log(`📨 [${message.id}] ${message.publishTime.toISOString()} ${message.data.toString()}`);
+        }
+        count++;
+        bytes += message.length;
+    }
+    const seconds = (Date.now() - start) / 1000;
+    console.log(`\n✅ ${count} mensagens (${(bytes / 1e6).toFixed(1)} MB) em ${seconds.toFixed(2)} s`);
+}
+
+runReplay().catch((error) => {
+    console.error('❌ Erro no replay:', error);
+    process.exit(1);
+});
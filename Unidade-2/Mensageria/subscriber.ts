@@ -1,5 +1,4 @@
-import { Subscriber } from './index';
-import { Message } from '@google-cloud/pubsub';
+import { Subscriber, ReceivedMessage } from './index';
 
 /*
  Exemplo de uso do Subscriber (Consumidor de mensagens)
@@ -12,13 +11,14 @@ async function runSubscriber() {
     // - 'mysub-2'
     const subscriptionName = 'mysub-1';
 
-    const subscriber = new Subscriber(subscriptionName);
+    // Controle de fluxo: até 1000 mensagens sem ACK e 10 handlers em paralelo
+    const subscriber = new Subscriber(subscriptionName, { maxOutstandingMessages: 1000, concurrency: 10 });
 
     console.log(`📡 Conectado à assinatura: ${subscriptionName}`);
     console.log('Aguardando mensagens... (Pressione Ctrl+C para sair)\n');
 
     // Handler personalizado para processar mensagens
-    const messageHandler = (message: Message) => {
+    const messageHandler = (message: ReceivedMessage) => {
         try {
             console.log('\n' + '='.repeat(60));
             console.log('📨 NOVA MENSAGEM RECEBIDA');
@@ -77,9 +77,19 @@ async function runSubscriber() {
     // Inicia a escuta de mensagens
     subscriber.startListening(messageHandler);
 
+    // Métricas periódicas (vazão, backlog local e atraso desde a publicação)
+    const metricsTimer = setInterval(() => {
+        const m = subscriber.getMetrics();
+        console.log(
+            `📈 ${m.throughput} msgs/s | recebidas ${m.received} | ack ${m.acked} | nack ${m.nacked} | ` +
+                `pendentes ${m.outstanding} (fila ${m.queued}, em execução ${m.running}) | atraso ${m.lagMs} ms`,
+        );
+    }, 10000);
+
     // Tratamento de sinais para encerramento gracioso
     process.on('SIGINT', () => {
         console.log('\n\n🛑 Encerrando subscriber...');
+        clearInterval(metricsTimer);
         subscriber.stopListening();
         console.log('👋 Subscriber finalizado!');
         process.exit(0);
@@ -12,6 +12,11 @@ declare global {
             SUBSCRIPTION_NAME_2: string;
             GOOGLE_APPLICATION_CREDENTIALS: string;
 
+            // Backend de mensageria ('pubsub' padrão, 'local' = broker em C)
+            MENSAGERIA_BACKEND?: 'pubsub' | 'local';
+            BROKER_HOST?: string;
+            BROKER_PORT?: string;
+
             // Node environment
             NODE_ENV?: 'development' | 'production' | 'test';
         }
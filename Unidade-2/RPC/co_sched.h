@@ -0,0 +1,409 @@
+// co_sched.h - corrotinas com pilha própria + escalonador com roubo de trabalho + reator epoll (header-only)
+#ifndef CO_SCHED_H
+#define CO_SCHED_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/*
+ * ESCALONADOR DE CORROTINAS (modo co do rpc_server)
+ * - Cada handler roda em uma corrotina com pilha própria (ucontext): o código continua
+ *   sequencial (lê, processa, responde), mas as esperas não bloqueiam a thread.
+ * - CO_WORKERS threads (padrão: uma por núcleo), cada uma com sua fila de prontas.
+ *   A thread tira da própria fila; vazia, rouba do fim da fila de outra; sem trabalho,
+ *   dorme até alguém publicar uma corrotina pronta.
+ * - Um reator (thread própria) espera em epoll pelos sockets e pelo heap de timers;
+ *   quando o evento chega ou o prazo vence, a corrotina volta para uma fila de prontas.
+ * - Ao esperar, a corrotina só registra o motivo e troca de contexto; o registro no
+ *   epoll/heap é feito pelo escalonador depois da troca, quando o contexto já está salvo
+ *   (senão o reator poderia retomá-la em outra thread antes de ela terminar de sair).
+ *
+ * Cuidado com variáveis por thread (TLS, inclusive errno): uma corrotina pode voltar em
+ * outra thread, e o compilador pode reaproveitar o endereço de TLS calculado antes da troca.
+ * Por isso co_self() e as chamadas de sistema abaixo ficam em funções noinline e
+ * co_recv/co_send devolvem o erro sem depender de errno lido antes da espera.
+ *
+ * Configuração (variáveis de ambiente):
+ *   CO_WORKERS=N   threads de trabalho (padrão: núcleos online)
+ *   CO_STACK=N     bytes de pilha por corrotina (padrão e mínimo: 65536)
+ *
+ * Cada pilha é um mmap próprio com uma página PROT_NONE logo abaixo dela: estourar a pilha
+ * dá SIGSEGV na hora em vez de corromper a memória vizinha. São duas regiões de memória
+ * por corrotina, então o teto de corrotinas vivas é cerca de vm.max_map_count / 2.
+ *
+ * Uso:
+ *   co_init();
+ *   co_spawn(handler, arg);             // de qualquer thread
+ *   dentro da corrotina: co_recv(), co_send(), co_sleep_ms(), co_self() != NULL
+ *   espera por outro evento: co_park_then(fn, arg); fn(c, arg) guarda c e, mais tarde, co_ready(c)
+ */
+
+#define CO_STACK_DEFAULT 65536
+#define CO_STACK_MIN     65536
+#define CO_MAX_WORKERS   64
+
+enum { CO_READY = 0, CO_YIELD, CO_WAIT_FD, CO_WAIT_TIMER, CO_WAIT_CALL, CO_DONE };
+
+typedef struct co {
+    ucontext_t ctx;
+    void (*fn)(void *);
+    void *arg;
+    char *stack;                // início do mmap (página de guarda + pilha)
+    int state;                  // motivo da última troca para o escalonador
+    int wait_fd;                // CO_WAIT_FD: socket e eventos esperados
+    uint32_t wait_events;
+    uint64_t wake_us;           // CO_WAIT_TIMER: prazo
+    int home;                   // fila em que foi publicada por último
+    void (*park_fn)(struct co *, void *);  // CO_WAIT_CALL: chamada pelo escalonador após a troca
+    void *park_arg;
+    struct co *wnext;           // encadeamento em listas de espera (ex.: co_park_then)
+} co_t;
+
+// Fila de prontas de uma thread de trabalho (anel que cresce; dona tira do início, ladrões do fim)
+typedef struct {
+    _Alignas(64) pthread_mutex_t mtx;
+    co_t **q; size_t cap, head, n;
+    ucontext_t sched;           // contexto do laço do escalonador desta thread
+    pthread_t th;
+    int id;
+} co_worker_t;
+
+typedef struct { uint64_t at; co_t *co; } co_timer_t;
+
+static struct {
+    int nworkers;
+    size_t stack, page;         // tamanho da pilha (múltiplo de page) e da página de guarda
+    co_worker_t w[CO_MAX_WORKERS];
+    _Atomic unsigned rr;        // distribuição das corrotinas novas
+    _Atomic long queued;        // corrotinas prontas em todas as filas
+    _Atomic int nidle;          // threads dormindo sem trabalho
+    pthread_mutex_t idle_mtx;
+    pthread_cond_t idle_cv;
+    int epfd, evfd;             // reator: epoll + eventfd para acordá-lo (timer novo mais cedo)
+    pthread_mutex_t tmr_mtx;
+    co_timer_t *heap; size_t nheap, capheap;
+    uint64_t reactor_at;        // prazo em que o reator vai acordar (UINT64_MAX = sem timer)
+    _Atomic uint64_t spawned, steals, switches;
+    _Atomic long live;          // corrotinas existentes
+} co_g = { .idle_mtx = PTHREAD_MUTEX_INITIALIZER, .idle_cv = PTHREAD_COND_INITIALIZER,
+           .tmr_mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread co_worker_t *co_tls_worker;
+static __thread co_t *co_tls_cur;
+
+static inline uint64_t co_now_us(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000;
+}
+
+// Corrotina em execução nesta thread (NULL fora de corrotina); noinline: ver nota sobre TLS
+static __attribute__((noinline)) co_t *co_self(void) { return co_tls_cur; }
+static __attribute__((noinline)) co_worker_t *co_worker_self(void) { return co_tls_worker; }
+
+// Publica uma corrotina pronta na fila `w` e acorda uma thread ociosa, se houver;
+// -1 se a fila precisava crescer e não houve memória (a corrotina não foi publicada)
+static int co_push(co_worker_t *w, co_t *c) {
+    pthread_mutex_lock(&w->mtx);
+    if (w->n == w->cap) {
+        size_t ncap = w->cap ? 2 * w->cap : 256;
+        co_t **nq = (co_t **) malloc(ncap * sizeof *nq);
+        if (!nq) { pthread_mutex_unlock(&w->mtx); return -1; }
+        for (size_t i = 0; i < w->n; i++) nq[i] = w->q[(w->head + i) % w->cap];
+        free(w->q); w->q = nq; w->cap = ncap; w->head = 0;
+    }
+    w->q[(w->head + w->n++) % w->cap] = c;
+    c->home = w->id;
+    pthread_mutex_unlock(&w->mtx);
+    atomic_fetch_add(&co_g.queued, 1);
+    if (atomic_load(&co_g.nidle) > 0) {
+        pthread_mutex_lock(&co_g.idle_mtx);
+        pthread_cond_signal(&co_g.idle_cv);
+        pthread_mutex_unlock(&co_g.idle_mtx);
+    }
+    return 0;
+}
+
+// Republica uma corrotina que já existe: perdê-la deixaria a conexão dela parada para sempre
+static void co_requeue(co_worker_t *w, co_t *c) {
+    if (co_push(w, c) < 0) { perror("co_push"); abort(); }
+}
+
+// Corrotina pronta de novo: volta para a fila em que estava (o roubo equilibra a carga)
+static inline void co_ready(co_t *c) { co_requeue(&co_g.w[c->home], c); }
+
+static co_t *co_take(co_worker_t *w, int from_tail) {
+    co_t *c = NULL;
+    if (from_tail ? pthread_mutex_trylock(&w->mtx) != 0 : pthread_mutex_lock(&w->mtx) != 0) return NULL;
+    if (w->n) {
+        if (from_tail) c = w->q[(w->head + w->n - 1) % w->cap];
+        else { c = w->q[w->head]; w->head = (w->head + 1) % w->cap; }
+        w->n--;
+    }
+    pthread_mutex_unlock(&w->mtx);
+    if (c) atomic_fetch_sub(&co_g.queued, 1);
+    return c;
+}
+
+// Rouba do fim da fila de outra thread, começando por uma vizinha diferente a cada vez
+static co_t *co_steal(co_worker_t *self) {
+    static _Atomic unsigned start;
+    unsigned s = atomic_fetch_add_explicit(&start, 1, memory_order_relaxed);
+    for (int k = 0; k < co_g.nworkers; k++) {
+        co_worker_t *v = &co_g.w[(s + (unsigned) k) % (unsigned) co_g.nworkers];
+        if (v == self || !v->n) continue;   // leitura sem lock: só uma dica
+        co_t *c = co_take(v, 1);
+        if (c) { atomic_fetch_add_explicit(&co_g.steals, 1, memory_order_relaxed); return c; }
+    }
+    return NULL;
+}
+
+// Insere no heap de timers; acorda o reator se este prazo vence antes do que ele espera.
+// Sem memória para crescer o heap, a corrotina volta pronta e co_sleep_ms espera de novo
+static void co_timer_add(co_t *c) {
+    pthread_mutex_lock(&co_g.tmr_mtx);
+    if (co_g.nheap == co_g.capheap) {
+        size_t ncap = co_g.capheap ? 2 * co_g.capheap : 1024;
+        co_timer_t *nh = (co_timer_t *) realloc(co_g.heap, ncap * sizeof *co_g.heap);
+        if (!nh) { pthread_mutex_unlock(&co_g.tmr_mtx); co_ready(c); return; }
+        co_g.heap = nh; co_g.capheap = ncap;
+    }
+    size_t i = co_g.nheap++;
+    while (i && co_g.heap[(i - 1) / 2].at > c->wake_us) { co_g.heap[i] = co_g.heap[(i - 1) / 2]; i = (i - 1) / 2; }
+    co_g.heap[i] = (co_timer_t) { c->wake_us, c };
+    int kick = c->wake_us < co_g.reactor_at;
+    if (kick) co_g.reactor_at = c->wake_us;
+    pthread_mutex_unlock(&co_g.tmr_mtx);
+    if (kick) { uint64_t one = 1; (void) !write(co_g.evfd, &one, sizeof one); }
+}
+
+// Retira o topo do heap se já venceu (chamada com tmr_mtx)
+static co_t *co_timer_pop(uint64_t now) {
+    if (!co_g.nheap || co_g.heap[0].at > now) return NULL;
+    co_t *c = co_g.heap[0].co;
+    co_timer_t last = co_g.heap[--co_g.nheap];
+    size_t i = 0;
+    for (;;) {
+        size_t l = 2 * i + 1;
+        if (l >= co_g.nheap) break;
+        if (l + 1 < co_g.nheap && co_g.heap[l + 1].at < co_g.heap[l].at) l++;
+        if (co_g.heap[l].at >= last.at) break;
+        co_g.heap[i] = co_g.heap[l]; i = l;
+    }
+    if (co_g.nheap) co_g.heap[i] = last;
+    return c;
+}
+
+// Reator: eventos de socket e timers vencidos tornam corrotinas prontas
+static void *co_reactor(void *p) {
+    (void) p;
+    struct epoll_event ev[256];
+    for (;;) {
+        pthread_mutex_lock(&co_g.tmr_mtx);
+        uint64_t now = co_now_us();
+        co_t *c;
+        while ((c = co_timer_pop(now))) co_ready(c);
+        co_g.reactor_at = co_g.nheap ? co_g.heap[0].at : UINT64_MAX;
+        int ms = co_g.nheap ? (int) ((co_g.reactor_at - now + 999) / 1000) : -1;
+        pthread_mutex_unlock(&co_g.tmr_mtx);
+
+        int n = epoll_wait(co_g.epfd, ev, 256, ms);
+        for (int i = 0; i < n; i++) {
+            if (ev[i].data.ptr == NULL) {   // eventfd: timer novo, só recalcula o prazo
+                uint64_t v; (void) !read(co_g.evfd, &v, sizeof v);
+                continue;
+            }
+            co_ready((co_t *) ev[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+static void co_free(co_t *c) {
+    munmap(c->stack, co_g.page + co_g.stack); free(c);
+    atomic_fetch_sub_explicit(&co_g.live, 1, memory_order_relaxed);
+}
+
+// Laço de uma thread de trabalho
+static void *co_worker_main(void *p) {
+    co_worker_t *w = (co_worker_t *) p;
+    co_tls_worker = w;
+    for (;;) {
+        co_t *c = co_take(w, 0);
+        if (!c) c = co_steal(w);
+        if (!c) {
+            // Sem trabalho: dorme até co_push avisar (nidle antes de reler queued evita perder o aviso)
+            pthread_mutex_lock(&co_g.idle_mtx);
+            atomic_fetch_add(&co_g.nidle, 1);
+            if (atomic_load(&co_g.queued) == 0) pthread_cond_wait(&co_g.idle_cv, &co_g.idle_mtx);
+            atomic_fetch_sub(&co_g.nidle, 1);
+            pthread_mutex_unlock(&co_g.idle_mtx);
+            continue;
+        }
+        c->home = w->id;
+        co_tls_cur = c;
+        swapcontext(&w->sched, &c->ctx);
+        co_tls_cur = NULL;
+        atomic_fetch_add_explicit(&co_g.switches, 1, memory_order_relaxed);
+
+        // O contexto da corrotina já está salvo: agora é seguro registrar a espera
+        switch (c->state) {
+        case CO_DONE: co_free(c); break;
+        case CO_YIELD: co_requeue(w, c); break;
+        case CO_WAIT_TIMER: co_timer_add(c); break;
+        case CO_WAIT_CALL: c->park_fn(c, c->park_arg); break;
+        case CO_WAIT_FD: {
+            struct epoll_event ev = { .events = c->wait_events | EPOLLONESHOT, .data.ptr = c };
+            if (epoll_ctl(co_g.epfd, EPOLL_CTL_MOD, c->wait_fd, &ev) < 0 &&
+                (errno != ENOENT || epoll_ctl(co_g.epfd, EPOLL_CTL_ADD, c->wait_fd, &ev) < 0))
+                co_requeue(w, c);  // não dá para esperar (fd inválido): a própria chamada vai falhar
+            break;
+        }
+        }
+    }
+    return NULL;
+}
+
+// Devolve o controle ao escalonador com o motivo `state`
+static void co_park(int state) {
+    co_t *c = co_self();
+    c->state = state;
+    swapcontext(&c->ctx, &co_worker_self()->sched);
+}
+
+static void co_entry(void) {
+    co_t *c = co_self();
+    c->fn(c->arg);
+    co_park(CO_DONE);  // não volta: o escalonador libera a pilha
+}
+
+// Cria uma corrotina e a publica em uma fila (distribuição circular); 0 ok, -1 sem memória
+static int co_spawn(void (*fn)(void *), void *arg) {
+    co_t *c = (co_t *) calloc(1, sizeof *c);
+    if (!c) return -1;
+    // A pilha cresce para baixo: a página de guarda fica no início do mapeamento
+    void *m = mmap(NULL, co_g.page + co_g.stack, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED) { free(c); return -1; }
+    if (mprotect(m, co_g.page, PROT_NONE) < 0) { munmap(m, co_g.page + co_g.stack); free(c); return -1; }
+    c->stack = (char *) m;
+    getcontext(&c->ctx);
+    c->ctx.uc_stack.ss_sp = c->stack + co_g.page;
+    c->ctx.uc_stack.ss_size = co_g.stack;
+    c->ctx.uc_link = NULL;
+    makecontext(&c->ctx, co_entry, 0);
+    c->fn = fn; c->arg = arg;
+    unsigned k = atomic_fetch_add_explicit(&co_g.rr, 1, memory_order_relaxed) % (unsigned) co_g.nworkers;
+    if (co_push(&co_g.w[k], c) < 0) { munmap(c->stack, co_g.page + co_g.stack); free(c); return -1; }
+    atomic_fetch_add_explicit(&co_g.spawned, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&co_g.live, 1, memory_order_relaxed);
+    return 0;
+}
+
+static inline void co_yield(void) { co_park(CO_YIELD); }
+
+/*
+ * Espera genérica: depois que o contexto foi salvo, o escalonador chama fn(c, arg), que
+ * deve ou guardar c em uma lista de espera (quem gerar o evento chama co_ready(c)) ou,
+ * se o evento já aconteceu, chamar co_ready(c) na hora.
+ */
+static inline void co_park_then(void (*fn)(co_t *, void *), void *arg) {
+    co_t *c = co_self();
+    c->park_fn = fn; c->park_arg = arg;
+    co_park(CO_WAIT_CALL);
+}
+
+static void co_sleep_ms(unsigned ms) {
+    uint64_t at = co_now_us() + (uint64_t) ms * 1000;
+    do {  // só volta antes do prazo se o heap de timers não pôde crescer
+        co_self()->wake_us = at;
+        co_park(CO_WAIT_TIMER);
+    } while (co_now_us() < at);
+}
+
+// Espera o socket ficar pronto (EPOLLIN/EPOLLOUT) sem bloquear a thread
+static void co_wait_fd(int fd, uint32_t events) {
+    co_t *c = co_self();
+    c->wait_fd = fd; c->wait_events = events;
+    co_park(CO_WAIT_FD);
+}
+
+// Chamadas de sistema que devolvem -errno (lido na mesma thread, antes de qualquer troca)
+static __attribute__((noinline)) ssize_t co_sys_recv(int fd, void *buf, size_t n, int flags) {
+    ssize_t r = recv(fd, buf, n, flags);
+    return r < 0 ? -errno : r;
+}
+static __attribute__((noinline)) ssize_t co_sys_send(int fd, const void *buf, size_t n, int flags) {
+    ssize_t r = send(fd, buf, n, flags);
+    return r < 0 ? -errno : r;
+}
+static __attribute__((noinline)) void co_set_errno(int e) { errno = e; }
+
+// recv/send de corrotina: o socket deve estar em O_NONBLOCK; EAGAIN vira espera no reator
+static ssize_t co_recv(int fd, void *buf, size_t n, int flags) {
+    for (;;) {
+        ssize_t r = co_sys_recv(fd, buf, n, flags);
+        if (r >= 0) return r;
+        if (r == -EAGAIN || r == -EWOULDBLOCK) co_wait_fd(fd, EPOLLIN);
+        else if (r != -EINTR) { co_set_errno((int) -r); return -1; }
+    }
+}
+
+static ssize_t co_send(int fd, const void *buf, size_t n, int flags) {
+    for (;;) {
+        ssize_t r = co_sys_send(fd, buf, n, flags | MSG_NOSIGNAL);
+        if (r >= 0) return r;
+        if (r == -EAGAIN || r == -EWOULDBLOCK) co_wait_fd(fd, EPOLLOUT);
+        else if (r != -EINTR) { co_set_errno((int) -r); return -1; }
+    }
+}
+
+// Sobe as threads de trabalho e o reator; 0 ok, -1 erro
+static int co_init(void) {
+    const char *v;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    co_g.nworkers = (v = getenv("CO_WORKERS")) ? atoi(v) : (int) (ncpu > 0 ? ncpu : 1);
+    if (co_g.nworkers < 1) co_g.nworkers = 1;
+    if (co_g.nworkers > CO_MAX_WORKERS) co_g.nworkers = CO_MAX_WORKERS;
+    long pg = sysconf(_SC_PAGESIZE);
+    co_g.page = pg > 0 ? (size_t) pg : 4096;
+    co_g.stack = (v = getenv("CO_STACK")) ? (size_t) atol(v) : CO_STACK_DEFAULT;
+    if (co_g.stack < CO_STACK_MIN) co_g.stack = CO_STACK_MIN;
+    co_g.stack = (co_g.stack + co_g.page - 1) / co_g.page * co_g.page;
+    co_g.reactor_at = UINT64_MAX;
+
+    if ((co_g.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) { perror("epoll_create1"); return -1; }
+    if ((co_g.evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) { perror("eventfd"); return -1; }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(co_g.epfd, EPOLL_CTL_ADD, co_g.evfd, &ev);
+
+    for (int i = 0; i < co_g.nworkers; i++) {
+        co_g.w[i].id = i;
+        pthread_mutex_init(&co_g.w[i].mtx, NULL);
+        if (pthread_create(&co_g.w[i].th, NULL, co_worker_main, &co_g.w[i]) != 0) return -1;
+        pthread_detach(co_g.w[i].th);
+    }
+    pthread_t r;
+    if (pthread_create(&r, NULL, co_reactor, NULL) != 0) return -1;
+    pthread_detach(r);
+    return 0;
+}
+
+static void co_report(const char *tag) {
+    fprintf(stderr, "%s corrotinas: %llu criadas, %ld ativas, %llu trocas, %llu roubos (%d threads)\n", tag,
+        (unsigned long long) co_g.spawned, (long) co_g.live, (unsigned long long) co_g.switches,
+        (unsigned long long) co_g.steals, co_g.nworkers);
+}
+
+#endif // CO_SCHED_H
@@ -1,12 +1,16 @@
 // gcc rpc_client.c -o rpc_client
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdint.h>
 
@@ -14,14 +18,23 @@
  * RPC CLIENT (TCP)
  * - Stubs de alto nível:
  *     int rpc_add(const char* ip, int port, int a, int b, int* result_out)
+ *     int rpc_trace_dump(const char* ip, int port, char* path_out, size_t n)
+ *     int rpc_stats(const char* ip, int port, char* text_out, size_t n)
  * - Cada chamada abre uma conexão, envia request, lê resposta e fecha.
+ * - bench N: abre N chamadas ADD simultâneas (uma conexão cada) em uma única thread com
+ *   epoll e mostra quantas concluíram e a latência (p50/p99/máx). Com K, os argumentos se
+ *   repetem a cada K chamadas (ADD(i % K, 1)), para exercitar o cache de resultados do servidor.
  * - Uso:
  *     ./rpc_client IP PORT add 7 35
+ *     ./rpc_client IP PORT trace
+ *     ./rpc_client IP PORT stats
+ *     ./rpc_client IP PORT bench 10000
+ *     ./rpc_client IP PORT bench 1000 1
  */
 
 #define BUFSZ 4096
 // Define os códigos de operação para identificar qual função remota chamar
-enum { OP_ADD = 1 };
+enum { OP_ADD = 1, OP_TRACE_DUMP = 100, OP_STATS = 101, OP_BUSY = 503 };
 
 // Estrutura do cabeçalho da mensagem RPC
 typedef struct {
@@ -72,7 +85,7 @@ static ssize_t read_full(int fd, void *buf, size_t n){
 static ssize_t write_full(int fd, const void *buf, size_t n){
   size_t sent = 0; const char *p = (const char*)buf;
   while (sent < n){
-    ssize_t r = send(fd, p + sent, n - sent, 0);
+    ssize_t r = send(fd, p + sent, n - sent, MSG_NOSIGNAL);  // erro em vez de SIGPIPE
     if (r <= 0){
       if (r < 0 && errno == EINTR) continue; // Interrupção - tenta novamente
       return -1;
@@ -85,7 +98,7 @@ static ssize_t write_full(int fd, const void *buf, size_t n){
 /* ===========================
  * STUB: rpc_add
  * Encapsula a interface: ADD(a,b) -> int
- * Retorna 0 em sucesso, <0 em erro.
+ * Retorna 0 em sucesso, -2 se o servidor recusou (BUSY), -1 em outros erros.
  * =========================== */
 int rpc_add(const char* ip, int port, int a, int b, int *result_out){
   // Conecta ao servidor
@@ -104,20 +117,23 @@ int rpc_add(const char* ip, int port, int a, int b, int *result_out){
   h.op  = htonl(OP_ADD);
   h.len = htonl(8);
 
-  // Envia cabeçalho + payload
-  if (write_full(s, &h, sizeof h) < 0 || write_full(s, payload, 8) < 0){
-    perror("send"); close(s); return -1;
-  }
+  // Envia cabeçalho + payload; se falhar, o servidor pode ter recusado (BUSY) e fechado
+  // antes de ler o pedido, então ainda tenta ler a resposta
+  bool send_err = write_full(s, &h, sizeof h) < 0 || write_full(s, payload, 8) < 0;
 
   // Lê cabeçalho da resposta
   rpc_hdr_t rh;
   if (read_full(s, &rh, sizeof rh) <= 0){
-    perror("recv header"); close(s); return -1;
+    perror(send_err ? "send" : "recv header"); close(s); return -1;
   }
   
   // Valida a resposta (deve ser OP_ADD com 4 bytes de resultado)
   uint32_t rop  = ntohl(rh.op);  // Converte de network byte order
   uint32_t rlen = ntohl(rh.len);
+  if (rop == OP_BUSY){
+    fprintf(stderr, "servidor ocupado (BUSY), tente mais tarde\n");
+    close(s); return -2;
+  }
   if (rop != OP_ADD || rlen != 4){
     fprintf(stderr, "resposta inválida (op=%u len=%u)\n", rop, rlen);
     close(s); return -1;
@@ -136,6 +152,158 @@ int rpc_add(const char* ip, int port, int a, int b, int *result_out){
   return 0;
 }
 
+/* ===========================
+ * Comandos de administração: requisição sem payload, resposta em texto
+ * =========================== */
+static int rpc_admin(const char* ip, int port, uint32_t op, char *text_out, size_t n){
+  int s = connect_tcp(ip, port);
+  if (s < 0) return -1;
+
+  // Cabeçalho sem payload
+  rpc_hdr_t h;
+  h.op  = htonl(op);
+  h.len = htonl(0);
+  bool send_err = write_full(s, &h, sizeof h) < 0;  // pode ter sido recusado (BUSY)
+
+  rpc_hdr_t rh;
+  if (read_full(s, &rh, sizeof rh) <= 0){ perror(send_err ? "send" : "recv header"); close(s); return -1; }
+  uint32_t rop  = ntohl(rh.op);
+  uint32_t rlen = ntohl(rh.len);
+  if (rop == OP_BUSY){
+    fprintf(stderr, "servidor ocupado (BUSY), tente mais tarde\n");
+    close(s); return -2;
+  }
+  if (rop != op || rlen == 0 || rlen >= n){
+    fprintf(stderr, "resposta inválida (op=%u len=%u)\n", rop, rlen);
+    close(s); return -1;
+  }
+  if (read_full(s, text_out, rlen) <= 0){ perror("recv body"); close(s); return -1; }
+  text_out[rlen] = '\0';
+  close(s);
+  return 0;
+}
+
+/* ===========================
+ * STUB: rpc_trace_dump
+ * Pede ao servidor para despejar o flight recorder (Chrome Trace JSON).
+ * Retorna 0 em sucesso e o caminho do arquivo (no servidor) em path_out.
+ * =========================== */
+int rpc_trace_dump(const char* ip, int port, char *path_out, size_t n){
+  return rpc_admin(ip, port, OP_TRACE_DUMP, path_out, n);
+}
+
+/* ===========================
+ * STUB: rpc_stats
+ * Pede os contadores do cache de resultados (acertos, faltas, tempo poupado).
+ * =========================== */
+int rpc_stats(const char* ip, int port, char *text_out, size_t n){
+  return rpc_admin(ip, port, OP_STATS, text_out, n);
+}
+
+/* ===========================
+ * CARGA: N chamadas ADD simultâneas
+ * Todas as conexões ficam abertas ao mesmo tempo; uma thread com epoll envia e lê.
+ * =========================== */
+typedef struct {
+  int fd, i;
+  bool sent;
+  size_t got;             // bytes da resposta já lidos (cabeçalho + 4)
+  char resp[12];
+  double t0;
+} bcall_t;
+
+static double now_s(void){
+  struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_dbl(const void *a, const void *b){
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+typedef struct { int ep, pending, ok, busy, fail; double *lat; } bench_t;
+
+// Trata os eventos prontos (timeout_ms = 0: só o que já chegou); retorna quantos eventos
+static int bench_poll(bench_t *B, int timeout_ms){
+  struct epoll_event evs[512];
+  int k = epoll_wait(B->ep, evs, 512, timeout_ms);
+  for (int e = 0; e < k; e++){
+    bcall_t *c = (bcall_t*)evs[e].data.ptr;
+    int done = 0;
+    if (!c->sent){
+      // Conectou: envia ADD(i, 1) de uma vez (16 bytes cabem no buffer do socket)
+      char req[16];
+      rpc_hdr_t h = { htonl(OP_ADD), htonl(8) };
+      int32_t a = (int32_t)htonl((uint32_t)c->i), b = (int32_t)htonl(1u);
+      memcpy(req, &h, 8); memcpy(req + 8, &a, 4); memcpy(req + 12, &b, 4);
+      if (send(c->fd, req, sizeof req, MSG_NOSIGNAL) != (ssize_t)sizeof req){ B->fail++; done = 1; }
+      else {
+        c->sent = true;
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(B->ep, EPOLL_CTL_MOD, c->fd, &ev);
+      }
+    } else {
+      ssize_t r = recv(c->fd, c->resp + c->got, sizeof c->resp - c->got, 0);
+      if (r < 0 && errno == EAGAIN) continue;
+      if (r > 0) c->got += (size_t)r;
+      rpc_hdr_t rh = { 0, 0 }; memcpy(&rh, c->resp, c->got >= 8 ? 8 : 0);
+      if (c->got >= 8 && ntohl(rh.op) == OP_BUSY){ B->busy++; done = 1; }
+      else if (c->got == sizeof c->resp){
+        int32_t ans; memcpy(&ans, c->resp + 8, 4);
+        if (ntohl(rh.op) == OP_ADD && (int32_t)ntohl((uint32_t)ans) == c->i + 1) B->lat[B->ok++] = now_s() - c->t0;
+        else B->fail++;
+        done = 1;
+      } else if (r <= 0){ B->fail++; done = 1; }
+    }
+    if (done){ close(c->fd); B->pending--; }
+  }
+  return k;
+}
+
+int rpc_bench(const char* ip, int port, int n, int keys){
+  // Cada chamada usa um descritor: sobe o limite até o máximo permitido
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0){ rl.rlim_cur = rl.rlim_max; setrlimit(RLIMIT_NOFILE, &rl); }
+
+  struct sockaddr_in srv;
+  memset(&srv, 0, sizeof srv);
+  srv.sin_family = AF_INET;
+  srv.sin_port = htons(port);
+  if (inet_pton(AF_INET, ip, &srv.sin_addr) != 1){ fprintf(stderr, "IP inválido: %s\n", ip); return -1; }
+
+  bench_t B = { .ep = epoll_create1(0) };
+  bcall_t *calls = (bcall_t*)calloc((size_t)n, sizeof *calls);
+  B.lat = (double*)malloc((size_t)n * sizeof *B.lat);
+  if (B.ep < 0 || !calls || !B.lat){ perror("bench"); return -1; }
+
+  double t0 = now_s();
+  for (int i = 0; i < n; i++){
+    bcall_t *c = &calls[i];
+    c->i = i % keys; c->t0 = now_s();
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0){ perror("socket"); B.fail += n - i; break; }
+    if (connect(c->fd, (struct sockaddr*)&srv, sizeof srv) < 0 && errno != EINPROGRESS){
+      perror("connect"); close(c->fd); B.fail++; continue;
+    }
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+    epoll_ctl(B.ep, EPOLL_CTL_ADD, c->fd, &ev);
+    B.pending++;
+    if (i % 256 == 255) bench_poll(&B, 0);  // envia nas que já conectaram enquanto abre as outras
+  }
+  printf("%d conexões abertas em %.2f s\n", n - B.fail, now_s() - t0);
+
+  while (B.pending > 0){
+    if (bench_poll(&B, 30000) <= 0){ fprintf(stderr, "bench: sem progresso há 30 s\n"); break; }
+  }
+  double total = now_s() - t0;
+  qsort(B.lat, (size_t)B.ok, sizeof *B.lat, cmp_dbl);
+  printf("%d chamadas em %.2f s: %d ok, %d BUSY, %d falhas\n", n, total, B.ok, B.busy, B.fail);
+  if (B.ok) printf("latência p50 %.3f s, p99 %.3f s, máx %.3f s\n", B.lat[B.ok / 2], B.lat[B.ok * 99 / 100], B.lat[B.ok - 1]);
+  free(calls); free(B.lat); close(B.ep);
+  return B.ok == n ? 0 : -1;
+}
+
 /* ===========================
  * MAIN de utilitário
  * =========================== */
@@ -143,14 +311,18 @@ static void usage(const char* prog){
   fprintf(stderr,
     "Uso:\n"
     "  %s IP PORT add A B\n"
+    "  %s IP PORT trace\n"
+    "  %s IP PORT stats\n"
+    "  %s IP PORT bench N [K]\n"
     "\nExemplo:\n"
     "  %s 192.168.56.102 5000 add 7 35\n",
-    prog, prog);
+    prog, prog, prog, prog, prog);
 }
 
 int main(int argc, char** argv){
   // Valida número mínimo de argumentos
-  if (argc != 6){
+  if (argc != 6 && !(argc == 4 && (strcmp(argv[3], "trace") == 0 || strcmp(argv[3], "stats") == 0)) &&
+      !((argc == 5 || argc == 6) && strcmp(argv[3], "bench") == 0)){
     usage(argv[0]);
     return 1;
   }
@@ -174,6 +346,31 @@ int main(int argc, char** argv){
       fprintf(stderr, "falha na chamada rpc_add\n");
       return 2;
     }
+  } else if (strcmp(cmd, "trace") == 0){
+    // Comando de administração: dump do flight recorder
+    char path[BUFSZ];
+    if (rpc_trace_dump(ip, port, path, sizeof path) == 0){
+      printf("trace salvo no servidor em %s\n", path);
+      return 0;
+    } else {
+      fprintf(stderr, "falha na chamada rpc_trace_dump\n");
+      return 2;
+    }
+  } else if (strcmp(cmd, "stats") == 0){
+    // Comando de administração: contadores do cache de resultados
+    char text[BUFSZ];
+    if (rpc_stats(ip, port, text, sizeof text) == 0){
+      printf("%s\n", text);
+      return 0;
+    } else {
+      fprintf(stderr, "falha na chamada rpc_stats\n");
+      return 2;
+    }
+  } else if (strcmp(cmd, "bench") == 0){
+    int n = atoi(argv[4]);
+    int k = argc == 6 ? atoi(argv[5]) : n;
+    if (n <= 0 || k <= 0){ fprintf(stderr, "N e K devem ser > 0\n"); return 1; }
+    return rpc_bench(ip, port, n, k) == 0 ? 0 : 2;
   } else {
     fprintf(stderr, "comando desconhecido: %s\n", cmd);
     usage(argv[0]);
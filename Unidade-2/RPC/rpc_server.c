@@ -2,6 +2,7 @@
 #define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <signal.h>
@@ -9,9 +10,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "../../comum/alog.h" // Logger assíncrono (ring buffer por thread)
+#include "../../comum/trace.h" // Trace de fases por requisição (dump com SIGUSR1)
+#include "../../comum/ratelimit.h" // Limite de taxa por IP e teto de requisições em andamento
+#include "co_sched.h" // Corrotinas + roubo de trabalho + reator epoll (modo co)
+
 /*
  * RPC SERVER (TCP)
  * - Interface binária simples:
@@ -19,15 +26,37 @@
  *     payload: depende da op
  * - Operações:
  *     OP_ADD  = 1  -> payload: [int32 a][int32 b]    resp: [int32 soma]
+ *     OP_TRACE_DUMP = 100 (administração) -> payload vazio   resp: caminho do dump JSON
+ *                     (só clientes 127.0.0.0/8, a menos que RPC_ADMIN_REMOTE=1)
+ *     OP_STATS      = 101 (administração) -> payload vazio   resp: texto com os contadores do cache
+ *     OP_BUSY = 503 (só resposta, sem payload): conexão recusada pelo controle de admissão
  * - Multithread: uma thread por conexão (cliente)
+ * - Modo co: cada conexão vira uma corrotina (co_sched.h) em poucas threads; read_full,
+ *   write_full e o sleep do processamento cedem a vez ao reator em vez de bloquear, então
+ *   o handler continua sequencial e o servidor aguenta centenas de milhares de chamadas
+ *   simultâneas (limitado por descritores e memória: ~64 KB de pilha por conexão).
+ * - Controle de admissão logo após o accept (../../comum/ratelimit.h): acima do limite por
+ *   IP ou do teto de conexões, o cliente recebe o cabeçalho OP_BUSY, sem thread
  * - Simula "processamento lento" com sleep(3)
+ * - Tabela de operações com flag de idempotência: resultados de operações idempotentes
+ *   (ADD) ficam em um cache dividido em partes, com chave = hash de op + payload. Chamadas
+ *   iguais simultâneas compartilham uma única execução (single-flight); as seguintes são
+ *   respondidas do cache até vencer o TTL. RPC_MEMO_N entradas (padrão 4096; 0 desliga),
+ *   RPC_MEMO_TTL_MS de validade (padrão 60000).
+ *
+ * Uso:
+ *   ./rpc_server <PORTA> [threads|co]
+ *
+ * Exemplo:
+ *   ./rpc_server 5000
+ *   RL_RATE=0 CO_WORKERS=4 ./rpc_server 5000 co
  */
 
 #define BACKLOG 64
 #define BUFSZ   4096
 
 // Enumeração das operações suportadas pelo servidor RPC
-enum { OP_ADD = 1 };
+enum { OP_ADD = 1, OP_TRACE_DUMP = 100, OP_STATS = 101, OP_BUSY = 503 };
 
 // Estrutura do cabeçalho RPC: contém operação e tamanho do payload
 typedef struct {
@@ -39,6 +68,7 @@ typedef struct {
 typedef struct {
     int cfd;                      // file descriptor da conexão do cliente
     struct sockaddr_in caddr;     // endereço IP e porta do cliente
+    trace_t tr;                   // marcas de tempo das fases da requisição
 } ctx_t;
 
 // Flag global para controlar o loop principal (sinal SIGINT)
@@ -51,7 +81,8 @@ static void on_sigint(int s) { (void) s; running = 0; fprintf(stderr, "[SRV] SIG
 static ssize_t read_full(int fd, void *buf, size_t n) {
     size_t got = 0; char *p = (char *) buf;
     while (got < n) {
-        ssize_t r = recv(fd, p + got, n - got, 0);
+        // Em corrotina, EAGAIN vira espera no reator (o socket está em O_NONBLOCK)
+        ssize_t r = co_self() ? co_recv(fd, p + got, n - got, 0) : recv(fd, p + got, n - got, 0);
         if (r == 0) return 0;       // conexão fechada
         if (r < 0) {
             if (errno == EINTR) continue;  // interrupção por sinal, tenta novamente
@@ -66,7 +97,7 @@ static ssize_t read_full(int fd, void *buf, size_t n) {
 static ssize_t write_full(int fd, const void *buf, size_t n) {
     size_t sent = 0; const char *p = (const char *) buf;
     while (sent < n) {
-        ssize_t r = send(fd, p + sent, n - sent, 0);
+        ssize_t r = co_self() ? co_send(fd, p + sent, n - sent, 0) : send(fd, p + sent, n - sent, 0);
         if (r <= 0) {
             if (r < 0 && errno == EINTR) continue;
             return -1;
@@ -76,13 +107,262 @@ static ssize_t write_full(int fd, const void *buf, size_t n) {
     return (ssize_t) sent;
 }
 
+// Espera sem bloquear a thread quando está em corrotina
+static void rpc_sleep(unsigned s) {
+    if (co_self()) co_sleep_ms(s * 1000);
+    else sleep(s);
+}
+
 // Implementação da operação ADD: soma dois inteiros
 static int32_t svc_add(int32_t a, int32_t b) {
     return a + b;
 }
 
+// Stub do servidor para ADD: desserializa, executa e serializa (0 ok, -1 payload inválido)
+static int op_add(const char *in, uint32_t len, char *out, size_t *outlen) {
+    // Operação ADD: espera 2 inteiros (8 bytes)
+    if (len != 8) {
+        alog_num(ALOG_WARN, "[SRV] ADD com payload inválido (%llu)\n", len);
+        return -1;
+    }
+    // Desserializa os dois inteiros (network byte order -> host)
+    int32_t a_net, b_net; memcpy(&a_net, in, 4); memcpy(&b_net, in + 4, 4);
+    int32_t a = (int32_t) ntohl((uint32_t) a_net);
+    int32_t b = (int32_t) ntohl((uint32_t) b_net);
+
+    // Executa a operação
+    int32_t ans = svc_add(a, b);
+    // Serializa o resultado (host -> network byte order)
+    int32_t ans_net = (int32_t) htonl((uint32_t) ans);
+    memcpy(out, &ans_net, 4);
+    *outlen = 4;
+    return 0;
+}
+
+// Tabela de operações: idempotente = mesmo payload dá sempre a mesma resposta (pode ir para o cache)
+typedef struct {
+    uint32_t op;
+    const char *name;
+    bool idempotent;
+    int (*fn)(const char *in, uint32_t len, char *out, size_t *outlen);
+} rpc_op_t;
+
+static const rpc_op_t rpc_ops[] = {
+    { OP_ADD, "ADD", true, op_add },
+};
+
+static const rpc_op_t *rpc_find(uint32_t op) {
+    for (size_t i = 0; i < sizeof rpc_ops / sizeof rpc_ops[0]; i++)
+        if (rpc_ops[i].op == op) return &rpc_ops[i];
+    return NULL;
+}
+
+// Caminho completo de uma operação: processamento lento simulado + stub
+static int rpc_exec(const rpc_op_t *o, const char *in, uint32_t len, char *out, size_t *outlen) {
+    rpc_sleep(3);  // Simula processamento lento (requisito do trabalho)
+    return o->fn(in, len, out, outlen);
+}
+
+/* ===========================
+ * Cache de resultados (memoização de operações idempotentes)
+ * =========================== */
+#define MEMO_SHARDS  16
+#define MEMO_BUCKETS 256   // cadeias por parte
+
+typedef struct memo_entry {
+    uint64_t h;                     // hash de op + payload
+    uint32_t op, len;
+    char *key;                      // cópia do payload (confirma a chave em caso de colisão)
+    char *res; size_t reslen;
+    int done, err;                  // done = 0: em execução (single-flight)
+    int refs;                       // chamadas esperando/lendo esta entrada (não pode ser liberada)
+    uint64_t exec_us;               // custo da execução original (tempo poupado por acerto)
+    uint64_t expires_us;
+    pthread_cond_t *cv;             // espera das threads (cv da parte)
+    co_t *waiters;                  // espera das corrotinas
+    struct memo_shard *sh;
+    struct memo_entry *hnext, *prev, *next;  // cadeia hash + lista LRU (só concluídas)
+} memo_entry_t;
+
+typedef struct memo_shard {
+    _Alignas(64) pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    memo_entry_t *tab[MEMO_BUCKETS];
+    memo_entry_t *head, *tail;      // LRU: head = usada mais recentemente
+    size_t n;
+} memo_shard_t;
+
+static struct {
+    memo_shard_t *shards;
+    size_t cap;                     // entradas por parte
+    uint64_t ttl_us;
+    _Atomic uint64_t hits, misses, joined, expired, evicted, saved_us;
+} memo;
+
+static void memo_init(void) {
+    const char *v = getenv("RPC_MEMO_N");
+    size_t n = v ? (size_t) atol(v) : 4096;
+    v = getenv("RPC_MEMO_TTL_MS");
+    memo.ttl_us = (uint64_t) (v ? atof(v) : 60000) * 1000;
+    if (!n) return;
+    memo.cap = n / MEMO_SHARDS ? n / MEMO_SHARDS : 1;
+    memo.shards = (memo_shard_t *) calloc(MEMO_SHARDS, sizeof *memo.shards);
+    for (int i = 0; memo.shards && i < MEMO_SHARDS; i++) {
+        pthread_mutex_init(&memo.shards[i].mtx, NULL);
+        pthread_cond_init(&memo.shards[i].cv, NULL);
+    }
+}
+
+static uint64_t memo_hash(uint32_t op, const char *p, uint32_t len) {
+    uint64_t h = 1469598103934665603ull;
+    for (int i = 0; i < 4; i++) { h ^= (uint8_t) (op >> (8 * i)); h *= 1099511628211ull; }
+    for (uint32_t i = 0; i < len; i++) { h ^= (uint8_t) p[i]; h *= 1099511628211ull; }
+    return h;
+}
+
+static void memo_lru_unlink(memo_shard_t *sh, memo_entry_t *e) {
+    if (e->prev) e->prev->next = e->next; else if (sh->head == e) sh->head = e->next;
+    if (e->next) e->next->prev = e->prev; else if (sh->tail == e) sh->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void memo_lru_push(memo_shard_t *sh, memo_entry_t *e) {
+    e->prev = NULL; e->next = sh->head;
+    if (sh->head) sh->head->prev = e; else sh->tail = e;
+    sh->head = e;
+}
+
+// Remove uma entrada concluída e sem leitores (chamada com o lock da parte)
+static void memo_drop(memo_shard_t *sh, memo_entry_t *e) {
+    memo_entry_t **pp = &sh->tab[(e->h >> 32) % MEMO_BUCKETS];
+    while (*pp != e) pp = &(*pp)->hnext;
+    *pp = e->hnext;
+    memo_lru_unlink(sh, e);
+    free(e->key); free(e->res); free(e);
+    sh->n--;
+}
+
+// Chamada pelo escalonador depois que a corrotina saiu: entra na fila ou segue se já terminou
+static void memo_enlist(co_t *c, void *p) {
+    memo_entry_t *e = (memo_entry_t *) p;
+    pthread_mutex_lock(&e->sh->mtx);
+    if (e->done) co_ready(c);
+    else { c->wnext = e->waiters; e->waiters = c; }
+    pthread_mutex_unlock(&e->sh->mtx);
+}
+
+// Copia o resultado de uma entrada concluída (chamada com o lock da parte)
+static int memo_copy(memo_entry_t *e, char *out, size_t *outlen) {
+    if (e->err) return -1;
+    memcpy(out, e->res, e->reslen);
+    *outlen = e->reslen;
+    atomic_fetch_add_explicit(&memo.saved_us, e->exec_us, memory_order_relaxed);
+    return 0;
+}
+
+// Executa uma operação idempotente passando pelo cache
+static int memo_call(const rpc_op_t *o, const char *in, uint32_t len, char *out, size_t *outlen) {
+    uint64_t h = memo_hash(o->op, in, len);
+    memo_shard_t *sh = &memo.shards[h >> 60];          // 4 bits mais altos: parte
+    memo_entry_t **head = &sh->tab[(h >> 32) % MEMO_BUCKETS];
+    uint64_t now = co_now_us();
+
+    pthread_mutex_lock(&sh->mtx);
+    memo_entry_t *e = *head;
+    while (e && !(e->h == h && e->op == o->op && e->len == len && memcmp(e->key, in, len) == 0)) e = e->hnext;
+    if (e && e->done && now >= e->expires_us) {
+        atomic_fetch_add_explicit(&memo.expired, 1, memory_order_relaxed);
+        if (!e->refs) memo_drop(sh, e);
+        else { pthread_mutex_unlock(&sh->mtx); return rpc_exec(o, in, len, out, outlen); }  // ainda sendo lida
+        e = NULL;
+    }
+    if (e && e->done) {  // acerto: responde na hora
+        atomic_fetch_add_explicit(&memo.hits, 1, memory_order_relaxed);
+        memo_lru_unlink(sh, e); memo_lru_push(sh, e);
+        int rc = memo_copy(e, out, outlen);
+        pthread_mutex_unlock(&sh->mtx);
+        return rc;
+    }
+    if (e) {  // mesma chamada em execução: espera o resultado dela (single-flight)
+        atomic_fetch_add_explicit(&memo.joined, 1, memory_order_relaxed);
+        e->refs++;
+        if (co_self()) {
+            pthread_mutex_unlock(&sh->mtx);
+            co_park_then(memo_enlist, e);
+            pthread_mutex_lock(&sh->mtx);
+        } else {
+            while (!e->done) pthread_cond_wait(&sh->cv, &sh->mtx);
+        }
+        e->refs--;
+        int rc = memo_copy(e, out, outlen);
+        pthread_mutex_unlock(&sh->mtx);
+        return rc;
+    }
+
+    // Falta: registra a execução pendente, abrindo espaço pela LRU (só concluídas sem leitores)
+    atomic_fetch_add_explicit(&memo.misses, 1, memory_order_relaxed);
+    for (memo_entry_t *v = sh->tail; v && sh->n >= memo.cap; ) {
+        memo_entry_t *prev = v->prev;
+        if (!v->refs) { memo_drop(sh, v); atomic_fetch_add_explicit(&memo.evicted, 1, memory_order_relaxed); }
+        v = prev;
+    }
+    if (sh->n >= memo.cap || !(e = (memo_entry_t *) calloc(1, sizeof *e)) || !(e->key = (char *) malloc(len ? len : 1))) {
+        free(e);
+        pthread_mutex_unlock(&sh->mtx);
+        return rpc_exec(o, in, len, out, outlen);  // sem espaço: executa sem cache
+    }
+    e->h = h; e->op = o->op; e->len = len; memcpy(e->key, in, len);
+    e->sh = sh;
+    e->hnext = *head; *head = e;
+    sh->n++;
+    pthread_mutex_unlock(&sh->mtx);
+
+    uint64_t t0 = co_now_us();
+    int rc = rpc_exec(o, in, len, out, outlen);
+    uint64_t t1 = co_now_us();
+
+    char *res = rc == 0 ? (char *) malloc(*outlen ? *outlen : 1) : NULL;
+    if (res) memcpy(res, out, *outlen);
+    pthread_mutex_lock(&sh->mtx);
+    e->res = res; e->reslen = res ? *outlen : 0;
+    e->err = !res;
+    e->exec_us = t1 - t0;
+    e->expires_us = e->err ? t1 : t1 + memo.ttl_us;  // erro não fica no cache
+    e->done = 1;
+    memo_lru_push(sh, e);
+    co_t *w = e->waiters; e->waiters = NULL;
+    pthread_cond_broadcast(&sh->cv);
+    pthread_mutex_unlock(&sh->mtx);
+    while (w) { co_t *nx = w->wnext; co_ready(w); w = nx; }
+    return rc;
+}
+
+// Texto com os contadores do cache (OP_STATS e encerramento)
+static size_t memo_stats(char *out, size_t n) {
+    uint64_t hits = memo.hits, joined = memo.joined, misses = memo.misses;
+    size_t entries = 0;
+    for (int i = 0; memo.shards && i < MEMO_SHARDS; i++) {
+        pthread_mutex_lock(&memo.shards[i].mtx);
+        entries += memo.shards[i].n;
+        pthread_mutex_unlock(&memo.shards[i].mtx);
+    }
+    uint64_t total = hits + joined + misses;
+    int m = snprintf(out, n, "cache: %llu acertos, %llu juntadas a execuções em andamento, %llu faltas "
+        "(taxa de acerto %.1f%%), %.1f s poupados, %zu entradas, %llu expiradas, %llu despejadas",
+        (unsigned long long) hits, (unsigned long long) joined, (unsigned long long) misses,
+        total ? 100.0 * (hits + joined) / total : 0.0, memo.saved_us / 1e6, entries,
+        (unsigned long long) memo.expired, (unsigned long long) memo.evicted);
+    return m < 0 ? 0 : (size_t) m < n ? (size_t) m : n - 1;
+}
+
+// Comandos que gravam no servidor (TRACE_DUMP) só para clientes locais, salvo RPC_ADMIN_REMOTE=1
+static bool admin_allowed(const struct sockaddr_in *peer) {
+    const char *v = getenv("RPC_ADMIN_REMOTE");
+    return (v && atoi(v) == 1) || (ntohl(peer->sin_addr.s_addr) >> 24) == 127;
+}
+
 // Função principal: processa uma requisição RPC
-static int handle_one_rpc(int cfd) {
+static int handle_one_rpc(int cfd, const struct sockaddr_in *peer, trace_t *tr) {
     rpc_hdr_t h;
     // 1. Lê o cabeçalho (8 bytes: op + len)
     if (read_full(cfd, &h, sizeof h) <= 0) return -1;
@@ -91,45 +371,53 @@ static int handle_one_rpc(int cfd) {
     uint32_t op = ntohl(h.op);
     uint32_t len = ntohl(h.len);
     if (len > BUFSZ) {
-        fprintf(stderr, "[SRV] payload grande demais (%u)\n", len);
+        alog_num(ALOG_WARN, "[SRV] payload grande demais (%llu)\n", len);
         return -1;
     }
 
     // 3. Lê o payload (dados da requisição)
     char buf[BUFSZ];
     if (len > 0 && read_full(cfd, buf, len) <= 0) return -1;
+    trace_mark(tr, "recv");
 
-    // 4. Simula processamento lento (requisito do trabalho)
-    sleep(3);
-
-    // 5. Processa a operação e monta a resposta
     rpc_hdr_t rh = { 0 };
     char out[BUFSZ];
     size_t outlen = 0;
 
-    if (op == OP_ADD) {
-        // Operação ADD: espera 2 inteiros (8 bytes)
-        if (len != 8) {
-            fprintf(stderr, "[SRV] ADD com payload inválido (%u)\n", len);
+    if (op == OP_TRACE_DUMP) {
+        // Comando de administração: despeja o flight recorder e devolve o caminho (sem sleep)
+        if (!admin_allowed(peer)) {
+            alog_peer(ALOG_WARN, "[SRV] TRACE_DUMP recusado para %s:%d (RPC_ADMIN_REMOTE=1 libera)\n", peer);
             return -1;
         }
-        // Desserializa os dois inteiros (network byte order -> host)
-        int32_t a_net, b_net; memcpy(&a_net, buf, 4); memcpy(&b_net, buf + 4, 4);
-        int32_t a = (int32_t) ntohl((uint32_t) a_net);
-        int32_t b = (int32_t) ntohl((uint32_t) b_net);
-
-        // Executa a operação
-        int32_t ans = svc_add(a, b);
-        // Serializa o resultado (host -> network byte order)
-        int32_t ans_net = (int32_t) htonl((uint32_t) ans);
-        memcpy(out, &ans_net, 4);
-        outlen = 4;
-    }
-    else {
-        fprintf(stderr, "[SRV] op desconhecida: %u\n", op);
+        trace_dump_path(out, sizeof out);
+        if (trace_dump(out) < 0) return -1;
+        outlen = strlen(out);
+        alog_str(ALOG_INFO, "[SRV] trace despejado em %.*s\n", out, outlen);
+        goto reply;
+    }
+
+    if (op == OP_STATS) {
+        // Comando de administração: contadores do cache de resultados
+        outlen = memo_stats(out, sizeof out);
+        goto reply;
+    }
+
+    // 4. Procura a operação na tabela
+    const rpc_op_t *o = rpc_find(op);
+    if (!o) {
+        alog_num(ALOG_WARN, "[SRV] op desconhecida: %llu\n", op);
         return -1;
     }
 
+    // 5. Processa (operações idempotentes passam pelo cache) e monta a resposta
+    int rc = o->idempotent && memo.shards ? memo_call(o, buf, len, out, &outlen)
+                                          : rpc_exec(o, buf, len, out, &outlen);
+    if (rc < 0) return -1;
+
+    trace_mark(tr, "process");
+
+reply:
     // 6. Monta e envia cabeçalho da resposta
     rh.op = htonl(op);
     rh.len = htonl((uint32_t) outlen);
@@ -137,6 +425,7 @@ static int handle_one_rpc(int cfd) {
     if (write_full(cfd, &rh, sizeof rh) < 0) return -1;
     // 7. Envia o payload da resposta
     if (outlen && write_full(cfd, out, outlen) < 0) return -1;
+    trace_mark(tr, "send");
 
     return 0;
 }
@@ -144,26 +433,31 @@ static int handle_one_rpc(int cfd) {
 // Thread worker: atende um cliente
 static void *worker(void *p) {
     ctx_t *ctx = (ctx_t *) p;
-    // Extrai informações do cliente para log
-    char ip[INET_ADDRSTRLEN]; inet_ntop(AF_INET, &ctx->caddr.sin_addr, ip, sizeof ip);
-    int cport = ntohs(ctx->caddr.sin_port);
-    fprintf(stderr, "[SRV] cliente %s:%d conectado\n", ip, cport);
+    // Log binário do cliente (formatado pela thread do logger)
+    trace_mark(&ctx->tr, "dispatch");  // espera até a thread começar a rodar
+    alog_peer(ALOG_INFO, "[SRV] cliente %s:%d conectado\n", &ctx->caddr);
 
     // Processa uma requisição RPC
-    (void) handle_one_rpc(ctx->cfd);
+    (void) handle_one_rpc(ctx->cfd, &ctx->caddr, &ctx->tr);
+    trace_commit(&ctx->tr);  // guarda no flight recorder (mesmo se a requisição falhou)
     // Fecha conexão e libera recursos
     close(ctx->cfd);
-    fprintf(stderr, "[SRV] cliente %s:%d desconectado\n", ip, cport);
+    alog_peer(ALOG_INFO, "[SRV] cliente %s:%d desconectado\n", &ctx->caddr);
     free(ctx);
+    rl_done();  // libera a vaga no teto de conexões em andamento
     return NULL;
 }
 
+// Corpo da corrotina (modo co): o mesmo handler das threads
+static void co_handler(void *p) { (void) worker(p); }
+
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "uso: %s <PORTA>\n", argv[0]);
+    if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "co") && strcmp(argv[2], "threads"))) {
+        fprintf(stderr, "uso: %s <PORTA> [threads|co]\n", argv[0]);
         return 1;
     }
     int port = atoi(argv[1]);
+    bool co = argc == 3 && strcmp(argv[2], "co") == 0;
 
     // Configura tratamento de SIGINT (Ctrl+C)
     struct sigaction sa = { 0 };
@@ -186,28 +480,65 @@ int main(int argc, char **argv) {
     // Associa socket ao endereço e porta
     if (bind(sfd, (struct sockaddr *) &srv, sizeof srv) < 0) { perror("bind"); return 1; }
     // Coloca socket em modo de escuta (fila de 64 conexões pendentes)
-    if (listen(sfd, BACKLOG) < 0) { perror("listen"); return 1; }
+    if (listen(sfd, co ? SOMAXCONN : BACKLOG) < 0) { perror("listen"); return 1; }
 
     fprintf(stderr, "[SRV] escutando 0.0.0.0:%d\n", port);
+    if (trace_init("rpc") < 0 || alog_init() < 0 || rl_init() < 0) {
+        fprintf(stderr, "[SRV] falha ao iniciar logger/trace/limitador\n");
+        return 1;
+    }
+    memo_init();
+    if (co) {
+        if (co_init() < 0) { fprintf(stderr, "[SRV] falha ao iniciar corrotinas\n"); return 1; }
+        // Uma conexão custa um descritor e uma pilha pequena: o teto natural passa a ser o de descritores
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+            if (!getenv("RL_MAX_INFLIGHT")) rl_g.max_inflight = (int) (rl.rlim_cur > 1000000 ? 1000000 : rl.rlim_cur);
+        }
+        fprintf(stderr, "[SRV] modo co: %d threads, teto de %d conexões\n", co_g.nworkers, rl_g.max_inflight);
+    }
 
     // Loop principal: aceita conexões
     while (running) {
         struct sockaddr_in cli; socklen_t cl = sizeof cli;
         // Aceita nova conexão (bloqueante)
         int cfd = accept(sfd, (struct sockaddr *) &cli, &cl);
+        uint64_t t_acc = trace_now();
         if (cfd < 0) {
             if (errno == EINTR) break;  // interrompido por sinal
             perror("accept"); continue;
         }
+        // Admissão antes de qualquer alocação: responde só o cabeçalho OP_BUSY e fecha
+        if (rl_admit(&cli) != RL_OK) {
+            rpc_hdr_t busy = { htonl(OP_BUSY), 0 };
+            rl_reject_stream(cfd, &busy, sizeof busy);
+            continue;
+        }
         // Aloca contexto para o cliente
         ctx_t *ctx = (ctx_t *) malloc(sizeof * ctx);
         ctx->cfd = cfd; ctx->caddr = cli;
+        // Início do trace = chegada do cliente (estimada pelo kernel): a fase "accept" é a espera na fila
+        trace_begin_at(&ctx->tr, &cli, trace_tcp_arrival(cfd, t_acc));
+        trace_mark(&ctx->tr, "accept");
 
+        if (co) {
+            // Corrotina: o socket fica não bloqueante e as esperas vão para o reator
+            fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+            if (co_spawn(co_handler, ctx) < 0) { close(cfd); free(ctx); rl_done(); }
+            continue;
+        }
         // Cria thread detached para atender o cliente
         pthread_t th; pthread_create(&th, NULL, worker, ctx);
         pthread_detach(th);  // thread se auto-limpa ao terminar
     }
     close(sfd);
+    alog_shutdown();  // drena os registros pendentes antes de sair
+    rl_report("[SRV]");
+    char st[512]; memo_stats(st, sizeof st);
+    fprintf(stderr, "[SRV] %s\n", st);
+    if (co) co_report("[SRV]");
     fprintf(stderr, "[SRV] encerrado\n");
     return 0;
 }
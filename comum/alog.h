@@ -0,0 +1,312 @@
+// alog.h - logger assíncrono (header-only) para os servidores
+#ifndef ALOG_H
+#define ALOG_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * LOGGER ASSÍNCRONO EM RING BUFFER
+ * - Cada thread escreve registros binários (sem formatar) no seu próprio ring SPSC,
+ *   sem locks e sem chamadas de sistema no caminho da requisição.
+ * - Uma thread de fundo drena todos os rings, ordena por timestamp, faz a formatação
+ *   (incluindo inet_ntop) e escreve em stderr com um único write() por lote.
+ * - Se o ring estiver cheio o registro é descartado e contado (nunca bloqueia).
+ * - Rings de threads encerradas são reaproveitados (servidores criam uma thread por requisição).
+ *
+ * Configuração (variáveis de ambiente):
+ *   ALOG_LEVEL=debug|info|warn|error   nível mínimo (padrão: info)
+ *   ALOG_SAMPLE=N                      registra 1 a cada N registros abaixo de WARN (padrão: 1)
+ *   ALOG_TS=1                          prefixa cada linha com horário (HH:MM:SS.uuuuuu)
+ *
+ * Uso:
+ *   alog_init();
+ *   alog_peer(ALOG_INFO, "[TCP] conexão %s:%d\n", &addr);
+ *   alog_shutdown();   // drena tudo antes de sair
+ */
+
+#define ALOG_RING_CAP 1024   // registros por thread (potência de 2)
+#define ALOG_STR_MAX  96     // bytes de texto copiados por registro (trunca o resto)
+#define ALOG_BATCH    4096   // registros formatados por rodada da thread de fundo
+#define ALOG_OUTSZ    65536  // buffer de saída da thread de fundo
+
+enum { ALOG_DEBUG = 0, ALOG_INFO, ALOG_WARN, ALOG_ERROR };
+
+// Tipos de registro: definem quais argumentos o formato recebe na hora da formatação
+enum {
+    ALOG_K_TXT = 0,   // fmt sem argumentos
+    ALOG_K_NUM,       // fmt(%llu)
+    ALOG_K_STR,       // fmt(%.*s)
+    ALOG_K_PEER,      // fmt(%s:%d)            -> ip, porta
+    ALOG_K_PEER_STR,  // fmt(%s:%d ... %.*s)   -> ip, porta, texto
+};
+
+// Registro binário gravado pelo produtor (formatado só na thread de fundo)
+typedef struct {
+    uint64_t ts_ns;           // CLOCK_MONOTONIC
+    const char *fmt;          // literal de formato (não é copiado)
+    uint64_t num;             // argumento numérico
+    uint32_t ip;              // endereço IPv4 (network byte order)
+    uint16_t port;            // porta (host byte order)
+    uint16_t slen;            // bytes válidos em s
+    uint8_t level, kind;
+    char s[ALOG_STR_MAX];     // cópia truncada do texto
+} alog_rec_t;
+
+// Ring de uma thread: head só é escrito pelo produtor, tail só pelo consumidor
+typedef struct alog_ring {
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    _Atomic uint64_t dropped;       // incrementado pelo produtor quando o ring está cheio
+    uint64_t dropped_seen;          // já contabilizado pelo consumidor
+    _Atomic int dead;               // thread dona encerrou
+    struct alog_ring *next;
+    alog_rec_t rec[ALOG_RING_CAP];
+} alog_ring_t;
+
+// Estado global do logger
+static struct {
+    int level, sample, ts;
+    int started;
+    _Atomic int stop;
+    pthread_t th;
+    pthread_key_t key;
+    pthread_mutex_t mtx;            // protege as listas (só no registro/reciclagem de rings)
+    alog_ring_t *active, *free;
+    uint64_t dropped_total;
+    int64_t wall_off_ns;            // REALTIME - MONOTONIC (para ALOG_TS)
+    _Atomic uint32_t sample_count;  // contador de amostragem (global: threads de vida curta também são amostradas)
+} alog_g = { .level = ALOG_INFO, .sample = 1, .mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread alog_ring_t *alog_tls_ring;
+
+static inline uint64_t alog_now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Destrutor da chave TLS: marca o ring como órfão (o consumidor drena e recicla)
+static void alog_thread_exit(void *p) {
+    atomic_store_explicit(&((alog_ring_t *) p)->dead, 1, memory_order_release);
+}
+
+// Obtém (ou registra) o ring da thread atual
+static alog_ring_t *alog_ring(void) {
+    alog_ring_t *r = alog_tls_ring;
+    if (r) return r;
+    pthread_mutex_lock(&alog_g.mtx);
+    r = alog_g.free;
+    if (r) alog_g.free = r->next;
+    pthread_mutex_unlock(&alog_g.mtx);
+    if (!r && !(r = (alog_ring_t *) calloc(1, sizeof *r))) return NULL;
+    atomic_store_explicit(&r->dead, 0, memory_order_relaxed);
+    pthread_mutex_lock(&alog_g.mtx);
+    r->next = alog_g.active; alog_g.active = r;
+    pthread_mutex_unlock(&alog_g.mtx);
+    pthread_setspecific(alog_g.key, r);
+    alog_tls_ring = r;
+    return r;
+}
+
+// Grava um registro no ring da thread (caminho rápido: sem lock, sem syscall)
+static void alog_write(int level, int kind, const char *fmt, const struct sockaddr_in *peer,
+                       uint64_t num, const char *s, size_t slen) {
+    if (level < alog_g.level || !alog_g.started) return;
+    // Contador único do processo: com um por thread, o 1º registro de cada thread (uma por
+    // requisição nos servidores) sempre passaria, e ALOG_SAMPLE=100 não daria 1%
+    if (level < ALOG_WARN && alog_g.sample > 1 &&
+        atomic_fetch_add_explicit(&alog_g.sample_count, 1, memory_order_relaxed) % (uint32_t) alog_g.sample != 0) return;
+
+    alog_ring_t *r = alog_ring();
+    if (!r) return;
+    uint32_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t t = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (h - t >= ALOG_RING_CAP) {  // cheio: descarta em vez de bloquear
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    alog_rec_t *e = &r->rec[h & (ALOG_RING_CAP - 1)];
+    e->ts_ns = alog_now_ns();
+    e->fmt = fmt; e->level = (uint8_t) level; e->kind = (uint8_t) kind;
+    e->num = num;
+    if (peer) { e->ip = peer->sin_addr.s_addr; e->port = ntohs(peer->sin_port); }
+    if (s) {
+        if (slen > ALOG_STR_MAX) slen = ALOG_STR_MAX;
+        memcpy(e->s, s, slen);
+        e->slen = (uint16_t) slen;
+    } else e->slen = 0;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+// API de alto nível: o formato deve aceitar exatamente os argumentos do tipo
+static inline void alog_txt(int lvl, const char *fmt) { alog_write(lvl, ALOG_K_TXT, fmt, NULL, 0, NULL, 0); }
+static inline void alog_num(int lvl, const char *fmt, uint64_t v) { alog_write(lvl, ALOG_K_NUM, fmt, NULL, v, NULL, 0); }
+static inline void alog_str(int lvl, const char *fmt, const char *s, size_t n) { alog_write(lvl, ALOG_K_STR, fmt, NULL, 0, s, n); }
+static inline void alog_peer(int lvl, const char *fmt, const struct sockaddr_in *a) { alog_write(lvl, ALOG_K_PEER, fmt, a, 0, NULL, 0); }
+static inline void alog_peer_str(int lvl, const char *fmt, const struct sockaddr_in *a, const char *s, size_t n) {
+    alog_write(lvl, ALOG_K_PEER_STR, fmt, a, 0, s, n);
+}
+
+// Ordena registros do lote por timestamp (rings de threads diferentes se intercalam)
+static int alog_cmp(const void *a, const void *b) {
+    uint64_t x = ((const alog_rec_t *) a)->ts_ns, y = ((const alog_rec_t *) b)->ts_ns;
+    return (x > y) - (x < y);
+}
+
+static void alog_flush_out(char *out, size_t *len) {
+    size_t off = 0;
+    while (off < *len) {
+        ssize_t w = write(STDERR_FILENO, out + off, *len - off);
+        if (w <= 0) break;  // stderr indisponível: descarta
+        off += (size_t) w;
+    }
+    *len = 0;
+}
+
+// Formata um registro no buffer de saída (executa apenas na thread de fundo)
+static void alog_format(const alog_rec_t *e, char *out, size_t *len) {
+    if (ALOG_OUTSZ - *len < 512) alog_flush_out(out, len);
+    char *p = out + *len; size_t room = ALOG_OUTSZ - *len;
+    int n = 0;
+    if (alog_g.ts) {
+        int64_t wall = (int64_t) e->ts_ns + alog_g.wall_off_ns;
+        time_t sec = (time_t) (wall / 1000000000);
+        struct tm tm; localtime_r(&sec, &tm);
+        n = snprintf(p, room, "%02d:%02d:%02d.%06ld ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+            (long) (wall % 1000000000) / 1000);
+    }
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr in = { .s_addr = e->ip };
+    switch (e->kind) {
+    case ALOG_K_TXT:      n += snprintf(p + n, room - n, "%s", e->fmt); break;
+    case ALOG_K_NUM:      n += snprintf(p + n, room - n, e->fmt, (unsigned long long) e->num); break;
+    case ALOG_K_STR:      n += snprintf(p + n, room - n, e->fmt, (int) e->slen, e->s); break;
+    case ALOG_K_PEER:
+        inet_ntop(AF_INET, &in, ip, sizeof ip);
+        n += snprintf(p + n, room - n, e->fmt, ip, (int) e->port);
+        break;
+    case ALOG_K_PEER_STR:
+        inet_ntop(AF_INET, &in, ip, sizeof ip);
+        n += snprintf(p + n, room - n, e->fmt, ip, (int) e->port, (int) e->slen, e->s);
+        break;
+    }
+    if (n > 0) *len += ((size_t) n < room) ? (size_t) n : room - 1;
+}
+
+// Thread de fundo: drena os rings, formata e escreve; recicla rings de threads mortas
+static void *alog_main(void *p) {
+    (void) p;
+    alog_rec_t *batch = (alog_rec_t *) malloc(sizeof *batch * ALOG_BATCH);
+    char *out = (char *) malloc(ALOG_OUTSZ);
+    if (!batch || !out) { free(batch); free(out); return NULL; }
+    size_t olen = 0;
+    uint64_t last_drop_report = 0, dropped_reported = 0;
+    unsigned idle_us = 1000;
+
+    for (;;) {
+        int stopping = atomic_load_explicit(&alog_g.stop, memory_order_acquire);
+        size_t nb = 0;
+
+        pthread_mutex_lock(&alog_g.mtx);
+        alog_ring_t *head = alog_g.active;
+        pthread_mutex_unlock(&alog_g.mtx);
+
+        // 1. Copia registros prontos de todos os rings para o lote
+        for (alog_ring_t *r = head; r && nb < ALOG_BATCH; r = r->next) {
+            uint32_t t = atomic_load_explicit(&r->tail, memory_order_relaxed);
+            uint32_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+            while (t != h && nb < ALOG_BATCH) batch[nb++] = r->rec[t++ & (ALOG_RING_CAP - 1)];
+            atomic_store_explicit(&r->tail, t, memory_order_release);
+            uint64_t d = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+            alog_g.dropped_total += d - r->dropped_seen; r->dropped_seen = d;
+        }
+
+        // 2. Recicla rings vazios de threads que já terminaram
+        pthread_mutex_lock(&alog_g.mtx);
+        for (alog_ring_t **pp = &alog_g.active; *pp;) {
+            alog_ring_t *r = *pp;
+            if (atomic_load_explicit(&r->dead, memory_order_acquire) &&
+                atomic_load_explicit(&r->head, memory_order_acquire) == atomic_load_explicit(&r->tail, memory_order_relaxed)) {
+                uint64_t d = atomic_load_explicit(&r->dropped, memory_order_relaxed);
+                alog_g.dropped_total += d - r->dropped_seen;
+                atomic_store_explicit(&r->dropped, 0, memory_order_relaxed); r->dropped_seen = 0;
+                *pp = r->next;
+                r->next = alog_g.free; alog_g.free = r;
+            } else pp = &r->next;
+        }
+        pthread_mutex_unlock(&alog_g.mtx);
+
+        // 3. Formata em ordem de tempo e escreve
+        if (nb) {
+            qsort(batch, nb, sizeof *batch, alog_cmp);
+            for (size_t i = 0; i < nb; i++) alog_format(&batch[i], out, &olen);
+        }
+        uint64_t now = alog_now_ns();
+        if (alog_g.dropped_total != dropped_reported && (now - last_drop_report > 1000000000ull || stopping)) {
+            alog_rec_t e = { .fmt = "[LOG] %llu registros descartados (ring cheio)\n", .kind = ALOG_K_NUM,
+                             .num = alog_g.dropped_total - dropped_reported, .ts_ns = now };
+            alog_format(&e, out, &olen);
+            dropped_reported = alog_g.dropped_total; last_drop_report = now;
+        }
+        if (olen) alog_flush_out(out, &olen);
+
+        if (nb == ALOG_BATCH) continue;  // ainda há atraso: não dorme
+        if (stopping) break;
+        if (nb) idle_us = 1000;
+        else if (idle_us < 16000) idle_us *= 2;  // backoff quando ocioso
+        struct timespec ts = { 0, (long) idle_us * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    free(batch); free(out);
+    return NULL;
+}
+
+static int alog_parse_level(const char *s) {
+    if (!strcasecmp(s, "debug")) return ALOG_DEBUG;
+    if (!strcasecmp(s, "warn")) return ALOG_WARN;
+    if (!strcasecmp(s, "error")) return ALOG_ERROR;
+    return ALOG_INFO;
+}
+
+// Inicializa o logger e a thread de fundo (chamar antes de criar as threads de trabalho)
+static int alog_init(void) {
+    const char *v;
+    if ((v = getenv("ALOG_LEVEL"))) alog_g.level = alog_parse_level(v);
+    if ((v = getenv("ALOG_SAMPLE")) && atoi(v) > 1) alog_g.sample = atoi(v);
+    if ((v = getenv("ALOG_TS"))) alog_g.ts = atoi(v) != 0;
+
+    struct timespec rt, mt;
+    clock_gettime(CLOCK_REALTIME, &rt); clock_gettime(CLOCK_MONOTONIC, &mt);
+    alog_g.wall_off_ns = ((int64_t) rt.tv_sec - mt.tv_sec) * 1000000000ll + (rt.tv_nsec - mt.tv_nsec);
+
+    if (pthread_key_create(&alog_g.key, alog_thread_exit) != 0) return -1;
+
+    // A thread de fundo não deve receber sinais (SIGINT fica com a thread principal)
+    sigset_t all, old; sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = pthread_create(&alog_g.th, NULL, alog_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) return -1;
+    alog_g.started = 1;
+    return 0;
+}
+
+// Para a thread de fundo após drenar tudo o que já foi registrado
+static void alog_shutdown(void) {
+    if (!alog_g.started) return;
+    atomic_store_explicit(&alog_g.stop, 1, memory_order_release);
+    pthread_join(alog_g.th, NULL);
+    alog_g.started = 0;
+}
+
+#endif // ALOG_H
@@ -0,0 +1,195 @@
+// ratelimit.h - limite de taxa por IP (token bucket) e teto de requisições em andamento (header-only)
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alog.h"
+
+/*
+ * CONTROLE DE ADMISSÃO NA ENTRADA
+ * - Consultado logo após accept()/recvfrom(), antes de alocar o contexto ou criar a thread:
+ *   uma requisição recusada custa uma busca na tabela e uma resposta curta.
+ * - Token bucket por IP de origem: RL_RATE fichas por segundo, acumulando até RL_BURST.
+ *   A recarga é preguiçosa (calculada no acesso, pelo tempo desde o último uso).
+ * - Tabela hash dividida em RL_SHARDS partes, cada uma com seu mutex (threads que
+ *   consultam IPs diferentes raramente disputam o mesmo lock). Entradas ociosas há mais de
+ *   RL_IDLE_S segundos são removidas por uma varredura periódica de cada parte; acima de
+ *   RL_MAX_ENTRIES IPs por parte, os novos dividem um único bucket (memória limitada).
+ * - Teto global de requisições em andamento (RL_MAX_INFLIGHT): acima dele, recusa qualquer
+ *   cliente (sobrecarga) em vez de criar mais threads.
+ *
+ * Configuração (variáveis de ambiente):
+ *   RL_RATE=N          requisições por segundo por IP (padrão: 50; 0 desliga o limite por IP)
+ *   RL_BURST=N         rajada máxima por IP (padrão: 2 x RL_RATE)
+ *   RL_MAX_INFLIGHT=N  requisições em andamento no servidor (padrão: 512; 0 = sem teto)
+ *   RL_IDLE_S=N        segundos até esquecer um IP ocioso (padrão: 60)
+ *
+ * Uso:
+ *   rl_init();
+ *   if (rl_admit(&addr) != RL_OK) { responde "BUSY"; continue; }
+ *   ... cria a thread; ao terminar a requisição: rl_done();
+ *   rl_report("[TCP]");   // contadores no encerramento
+ */
+
+#define RL_SHARDS      64
+#define RL_BUCKETS     256      // cadeias por parte
+#define RL_MAX_ENTRIES 4096     // IPs por parte
+#define RL_SWEEP_US    1000000  // intervalo entre varreduras de uma parte
+
+enum { RL_OK = 0, RL_LIMITED, RL_BUSY };
+
+typedef struct rl_entry {
+    uint32_t ip;              // network byte order
+    int limited;              // já avisou no log neste episódio
+    double tokens;
+    uint64_t last_us;         // último acesso (referência da recarga)
+    struct rl_entry *next;
+} rl_entry_t;
+
+typedef struct {
+    _Alignas(64) pthread_mutex_t mtx;
+    rl_entry_t *head[RL_BUCKETS];
+    rl_entry_t *free;         // entradas removidas, reaproveitadas sem malloc
+    rl_entry_t overflow;      // bucket compartilhado quando a parte está cheia
+    uint32_t n;
+    uint64_t next_sweep_us;
+} rl_shard_t;
+
+static struct {
+    double rate, burst;
+    int max_inflight;
+    uint64_t idle_us;
+    rl_shard_t *shards;
+    _Atomic int inflight;
+    _Atomic uint64_t admitted, limited, shed;
+    _Atomic uint64_t shed_log_us;   // último aviso de sobrecarga (no máximo 1 por segundo)
+} rl_g;
+
+static inline uint64_t rl_now_us(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000ull + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static int rl_init(void) {
+    const char *v;
+    rl_g.rate = (v = getenv("RL_RATE")) ? atof(v) : 50;
+    rl_g.burst = (v = getenv("RL_BURST")) ? atof(v) : 2 * rl_g.rate;
+    if (rl_g.burst < 1) rl_g.burst = 1;
+    rl_g.max_inflight = (v = getenv("RL_MAX_INFLIGHT")) ? atoi(v) : 512;
+    rl_g.idle_us = (uint64_t) (((v = getenv("RL_IDLE_S")) ? atof(v) : 60) * 1e6);
+    // Um IP só pode ser esquecido depois de recarregar o bucket inteiro (esquecer = bucket cheio)
+    if (rl_g.rate > 0 && rl_g.idle_us < rl_g.burst / rl_g.rate * 1e6)
+        rl_g.idle_us = (uint64_t) (rl_g.burst / rl_g.rate * 1e6);
+    if (rl_g.rate <= 0) return 0;
+    rl_g.shards = (rl_shard_t *) calloc(RL_SHARDS, sizeof *rl_g.shards);
+    if (!rl_g.shards) return -1;
+    for (int i = 0; i < RL_SHARDS; i++) {
+        pthread_mutex_init(&rl_g.shards[i].mtx, NULL);
+        rl_g.shards[i].overflow.tokens = rl_g.burst;
+    }
+    return 0;
+}
+
+// Remove as entradas ociosas de uma parte (chamada com o lock da parte)
+static void rl_sweep(rl_shard_t *sh, uint64_t now) {
+    for (int b = 0; b < RL_BUCKETS; b++) {
+        rl_entry_t **pp = &sh->head[b];
+        while (*pp) {
+            rl_entry_t *e = *pp;
+            if (now - e->last_us < rl_g.idle_us) { pp = &e->next; continue; }
+            *pp = e->next;
+            e->next = sh->free; sh->free = e;
+            sh->n--;
+        }
+    }
+    sh->next_sweep_us = now + RL_SWEEP_US;
+}
+
+// Consome uma ficha do IP; 0 = sem fichas
+static int rl_take(const struct sockaddr_in *peer, uint64_t now) {
+    uint32_t ip = peer->sin_addr.s_addr;
+    uint64_t h = (uint64_t) ip * 0x9E3779B97F4A7C15ull;
+    rl_shard_t *sh = &rl_g.shards[h >> 58];             // 6 bits mais altos: parte
+    rl_entry_t **head = &sh->head[(h >> 32) & (RL_BUCKETS - 1)];
+
+    pthread_mutex_lock(&sh->mtx);
+    if (now >= sh->next_sweep_us) rl_sweep(sh, now);
+    rl_entry_t *e = *head;
+    while (e && e->ip != ip) e = e->next;
+    if (!e) {
+        if (sh->n >= RL_MAX_ENTRIES) e = &sh->overflow;
+        else {
+            if ((e = sh->free)) sh->free = e->next;
+            else if (!(e = (rl_entry_t *) malloc(sizeof *e))) e = &sh->overflow;
+            if (e != &sh->overflow) {
+                e->ip = ip; e->limited = 0; e->tokens = rl_g.burst; e->last_us = now;
+                e->next = *head; *head = e;
+                sh->n++;
+            }
+        }
+    }
+    // Recarga preguiçosa: fichas acumuladas desde o último acesso
+    e->tokens += (double) (now - e->last_us) * rl_g.rate / 1e6;
+    if (e->tokens > rl_g.burst) e->tokens = rl_g.burst;
+    e->last_us = now;
+    int ok = e->tokens >= 1, first = 0;
+    if (ok) { e->tokens -= 1; e->limited = 0; }
+    else if (!e->limited) e->limited = first = 1;
+    pthread_mutex_unlock(&sh->mtx);
+
+    if (first) alog_peer(ALOG_WARN, "[RL] %s:%d excedeu o limite de taxa\n", peer);
+    return ok;
+}
+
+// Decide se a requisição entra: RL_OK (chamar rl_done() ao final), RL_LIMITED ou RL_BUSY
+static int rl_admit(const struct sockaddr_in *peer) {
+    uint64_t now = rl_now_us();
+    // Teto global primeiro: é só um contador atômico
+    int n = atomic_fetch_add_explicit(&rl_g.inflight, 1, memory_order_relaxed);
+    if (rl_g.max_inflight > 0 && n >= rl_g.max_inflight) {
+        atomic_fetch_sub_explicit(&rl_g.inflight, 1, memory_order_relaxed);
+        uint64_t shed = atomic_fetch_add_explicit(&rl_g.shed, 1, memory_order_relaxed) + 1;
+        uint64_t last = atomic_load_explicit(&rl_g.shed_log_us, memory_order_relaxed);
+        if (now - last >= 1000000 &&
+            atomic_compare_exchange_strong(&rl_g.shed_log_us, &last, now))
+            alog_num(ALOG_WARN, "[RL] sobrecarga: %llu requisições recusadas pelo teto global\n", shed);
+        return RL_BUSY;
+    }
+    if (rl_g.shards && !rl_take(peer, now)) {
+        atomic_fetch_sub_explicit(&rl_g.inflight, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&rl_g.limited, 1, memory_order_relaxed);
+        return RL_LIMITED;
+    }
+    atomic_fetch_add_explicit(&rl_g.admitted, 1, memory_order_relaxed);
+    return RL_OK;
+}
+
+// Fim de uma requisição admitida
+static inline void rl_done(void) {
+    atomic_fetch_sub_explicit(&rl_g.inflight, 1, memory_order_relaxed);
+}
+
+// Recusa barata em conexão TCP: descarta o que já chegou, responde sem bloquear e fecha
+static inline void rl_reject_stream(int fd, const void *msg, size_t n) {
+    char tmp[512];
+    while (recv(fd, tmp, sizeof tmp, MSG_DONTWAIT) > 0) {}  // evita RST com dados pendentes
+    (void) !send(fd, msg, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+    close(fd);
+}
+
+static void rl_report(const char *tag) {
+    fprintf(stderr, "%s limitador: %llu aceitas, %llu limitadas por IP, %llu recusadas por sobrecarga\n", tag,
+        (unsigned long long) rl_g.admitted, (unsigned long long) rl_g.limited, (unsigned long long) rl_g.shed);
+}
+
+#endif // RATELIMIT_H
@@ -0,0 +1,189 @@
+// trace.h - rastreamento de fases por requisição + flight recorder (header-only)
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * TRACE DE FASES POR REQUISIÇÃO
+ * - Cada requisição carrega um trace_t com até TRACE_MAX_MARKS marcas de tempo
+ *   (CLOCK_MONOTONIC via vDSO, ~20 ns por marca). Cada marca fecha a fase de mesmo nome
+ *   que começou na marca anterior: accept -> dispatch -> recv -> process -> send.
+ * - Ao final, trace_commit() copia o trace para um flight recorder circular em memória
+ *   com as últimas N requisições (seqlock por slot, sem lock global).
+ * - O recorder é despejado em JSON no formato Chrome Trace (chrome://tracing, Perfetto)
+ *   ao receber SIGUSR1 ou por chamada explícita a trace_dump() (comando de administração).
+ *
+ * Configuração (variáveis de ambiente):
+ *   TRACE_N=N       número de requisições mantidas (padrão: 1024)
+ *   TRACE_DIR=dir   diretório dos arquivos de dump (padrão: diretório atual)
+ *
+ * Uso:
+ *   trace_init("tcp");                // antes de criar as threads de trabalho
+ *   trace_t tr; trace_begin(&tr, &addr);
+ *   trace_mark(&tr, "recv"); ...
+ *   trace_commit(&tr);
+ *   kill -USR1 <pid>  ->  trace-tcp-<pid>-<n>.json
+ */
+
+#define TRACE_MAX_MARKS 8
+#define TRACE_DEFAULT_N 1024
+
+typedef struct {
+    uint64_t id;                          // número sequencial da requisição
+    uint32_t ip;                          // cliente (network byte order)
+    uint16_t port;                        // cliente (host byte order)
+    uint8_t n;                            // marcas válidas
+    const char *name[TRACE_MAX_MARKS];    // name[i] = fase que termina em ts[i] (name[0] = início)
+    uint64_t ts[TRACE_MAX_MARKS];
+} trace_t;
+
+// Slot do flight recorder: seq ímpar = escrita em andamento
+typedef struct {
+    _Atomic uint64_t seq;
+    trace_t tr;
+} trace_slot_t;
+
+static struct {
+    const char *prog;
+    trace_slot_t *slots;
+    uint64_t n;
+    _Atomic uint64_t next_id;
+    _Atomic uint64_t pos;
+    _Atomic unsigned dumps;
+    pthread_mutex_t dump_mtx;
+} trace_g = { .dump_mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static inline uint64_t trace_now(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+// Inicia o trace de uma requisição (t0 = agora)
+static inline void trace_begin(trace_t *t, const struct sockaddr_in *peer) {
+    t->id = atomic_fetch_add_explicit(&trace_g.next_id, 1, memory_order_relaxed) + 1;
+    t->ip = peer ? peer->sin_addr.s_addr : 0;
+    t->port = peer ? ntohs(peer->sin_port) : 0;
+    t->n = 1; t->name[0] = "start"; t->ts[0] = trace_now();
+}
+
+// Inicia o trace com t0 informado (ex.: estimativa de chegada antes do accept)
+static inline void trace_begin_at(trace_t *t, const struct sockaddr_in *peer, uint64_t t0) {
+    trace_begin(t, peer); t->ts[0] = t0;
+}
+
+// Chegada estimada de uma conexão TCP recém-aceita (t_acc = retorno do accept):
+// tcpi_last_ack_recv = ms desde o último ACK do cliente (o que completou o handshake ou o
+// primeiro dado logo em seguida), então a fase "accept" mede a espera real na fila.
+// Resolução de jiffies (1-4 ms); sem TCP_INFO, devolve t_acc (fase zero).
+static inline uint64_t trace_tcp_arrival(int fd, uint64_t t_acc) {
+    struct tcp_info ti;
+    socklen_t len = sizeof ti;
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) return t_acc;
+    uint64_t ago = (uint64_t) ti.tcpi_last_ack_recv * 1000000ull;
+    return ago < t_acc ? t_acc - ago : t_acc;
+}
+
+// Fecha a fase `phase` (do instante da marca anterior até agora)
+static inline void trace_mark(trace_t *t, const char *phase) {
+    if (t->n >= TRACE_MAX_MARKS) return;
+    t->name[t->n] = phase; t->ts[t->n] = trace_now(); t->n++;
+}
+
+// Copia o trace concluído para o flight recorder
+static inline void trace_commit(const trace_t *t) {
+    if (!trace_g.slots) return;
+    uint64_t p = atomic_fetch_add_explicit(&trace_g.pos, 1, memory_order_relaxed);
+    trace_slot_t *s = &trace_g.slots[p % trace_g.n];
+    uint64_t q = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, q | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s->tr = *t;
+    atomic_store_explicit(&s->seq, (q | 1) + 1, memory_order_release);
+}
+
+// Escreve o conteúdo do recorder em `path` no formato Chrome Trace JSON
+static int trace_dump(const char *path) {
+    if (!trace_g.slots) return -1;
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    pthread_mutex_lock(&trace_g.dump_mtx);
+    int pid = (int) getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", pid, trace_g.prog);
+    for (uint64_t i = 0; i < trace_g.n; i++) {
+        trace_slot_t *s = &trace_g.slots[i];
+        uint64_t q1 = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (q1 == 0 || (q1 & 1)) continue;  // vazio ou sendo escrito
+        trace_t t = s->tr;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) != q1 || t.n < 2) continue;
+
+        char ip[INET_ADDRSTRLEN]; struct in_addr in = { .s_addr = t.ip };
+        inet_ntop(AF_INET, &in, ip, sizeof ip);
+        // Um "tid" por requisição: cada linha do visualizador é uma requisição
+        // (o evento process_name vem antes, então todo evento daqui em diante leva vírgula)
+        fprintf(f, ",\n{\"name\":\"request\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%d,\"tid\":%llu,\"args\":{\"peer\":\"%s:%u\"}}", trace_g.prog,
+            t.ts[0] / 1e3, (t.ts[t.n - 1] - t.ts[0]) / 1e3, pid, (unsigned long long) t.id, ip, t.port);
+        for (int k = 1; k < t.n; k++) {
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%llu}",
+                t.name[k], trace_g.prog, t.ts[k - 1] / 1e3, (t.ts[k] - t.ts[k - 1]) / 1e3, pid,
+                (unsigned long long) t.id);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&trace_g.dump_mtx);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// Gera o próximo nome de arquivo de dump (trace-<prog>-<pid>-<n>.json)
+static void trace_dump_path(char *out, size_t n) {
+    const char *dir = getenv("TRACE_DIR");
+    unsigned k = atomic_fetch_add(&trace_g.dumps, 1) + 1;
+    snprintf(out, n, "%s/trace-%s-%d-%u.json", dir ? dir : ".", trace_g.prog, (int) getpid(), k);
+}
+
+// Thread que aguarda SIGUSR1 (via sigwait, fora de contexto de sinal) e despeja o recorder
+static void *trace_sig_main(void *p) {
+    (void) p;
+    sigset_t set; sigemptyset(&set); sigaddset(&set, SIGUSR1);
+    for (;;) {
+        int sig;
+        if (sigwait(&set, &sig) != 0) continue;
+        char path[512]; trace_dump_path(path, sizeof path);
+        if (trace_dump(path) == 0) fprintf(stderr, "[TRACE] dump em %s\n", path);
+        else perror("[TRACE] dump");
+    }
+    return NULL;
+}
+
+// Aloca o recorder e instala o despejo por SIGUSR1.
+// Deve ser chamada na thread principal antes de criar outras threads (herdam a máscara).
+static int trace_init(const char *prog) {
+    const char *v = getenv("TRACE_N");
+    trace_g.prog = prog;
+    trace_g.n = (v && atoi(v) > 0) ? (uint64_t) atoi(v) : TRACE_DEFAULT_N;
+    trace_g.slots = (trace_slot_t *) calloc(trace_g.n, sizeof *trace_g.slots);
+    if (!trace_g.slots) return -1;
+
+    sigset_t set; sigemptyset(&set); sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) return -1;
+    pthread_t th;
+    if (pthread_create(&th, NULL, trace_sig_main, NULL) != 0) return -1;
+    pthread_detach(th);
+    return 0;
+}
+
+#endif // TRACE_H